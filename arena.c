@@ -0,0 +1,394 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "players.h"
+
+// ARENA
+// Plays many games between two engines in one process, spread over a pool of threads,
+// and tells which of them is stronger. No referee and no pipes: every game just calls
+// the players' most_promising_move in turn.
+// The games start from random openings. Every opening is played twice, so both engines get to
+// play both sides of it. At the end (or whenever we print) we report wins, draws and losses
+// of the first engine, its Elo difference with a 95% error bar, and the log likelihood ratio
+// of the SPRT between elo0 and elo1. With -s, we stop as soon as the SPRT has decided.
+//
+// An engine is written as name[:depth[:endgame empties]], where name is heuristic or adaptive.
+//
+// usage: arena [-n games] [-j threads] [-p opening plies] [-S seed] [-t move ms] [-H hash MB]
+//              [-w weights] [-s elo0,elo1] [-r records] engine engine
+
+#define ARENA_GAMES 1000    // Default for -n
+#define ARENA_PLIES 8       // Default for -p
+#define ARENA_DEPTH 4       // When an engine doesn't say
+#define ARENA_ENDGAME 12    // When an engine doesn't say
+#define ARENA_HASH 16       // Default for -H, for every engine in every thread
+#define REPORT_GAMES 100    // How often we print the standings
+#define SPRT_ALPHA 0.05     // Chance to accept elo1 when elo0 is true
+#define SPRT_BETA 0.05      // And the other way around
+#define RECORD_LENGTH (2 * BOARD_WIDTH * BOARD_HEIGHT + 1)
+
+typedef enum Strategy
+{
+  HEURISTIC,
+  ADAPTIVE
+} Strategy;
+
+typedef struct Engine
+{
+  const char *name;
+  Strategy strategy;
+  int depth;
+  int endgame_empties;
+} Engine;
+
+typedef struct Arena
+{
+  Engine engines[2];
+  int games;
+  int plies;
+  unsigned seed;
+  double move_time; // 0 if only the depth counts
+  long hash_mb;
+  bool learned; // -w, the adaptive engine then evaluates like adaptive_player with -w
+  bool sprt; // Stop as soon as the SPRT decides
+  double elo0, elo1;
+  FILE *records;
+
+  pthread_mutex_t lock; // Guards everything below
+  int next;             // The next game a thread may take
+  int played;
+  int wins, draws, losses; // Of the first engine
+  bool decided;
+} Arena;
+
+// Everything one engine needs for a game, a thread keeps one for each engine.
+typedef struct Seat
+{
+  Engine *engine;
+  TranspositionTable tt;
+  Measure measure;
+  SearchContext ctx;
+} Seat;
+
+bool parse_engine(const char *spec, Engine *e)
+{
+  char name[32];
+  int n = sscanf(spec, "%31[a-z]:%d:%d", name, &e->depth, &e->endgame_empties);
+
+  e->name = spec;
+  if (n < 2)
+    e->depth = ARENA_DEPTH;
+  if (n < 3)
+    e->endgame_empties = ARENA_ENDGAME;
+
+  if (n < 1 || e->depth < 1 || e->endgame_empties < 0)
+    return false;
+
+  if (!strcmp(name, "heuristic"))
+    e->strategy = HEURISTIC;
+  else if (!strcmp(name, "adaptive"))
+    e->strategy = ADAPTIVE;
+  else
+    return false;
+
+  return true;
+}
+
+void new_game(Seat *seat)
+{
+  tt_clear(&seat->tt);
+  init_measure(&seat->measure);
+}
+
+uint_fast64_t choose_move(Seat *seat, Game *g, double move_time)
+{
+  seat->ctx.deadline = now_ms() + (move_time > 0 ? move_time : BILLION);
+
+  if (seat->engine->strategy == HEURISTIC)
+    return heuristic_player_most_promising_move(g, g->legal_moves, &seat->ctx);
+  return adaptive_player_most_promising_move(g, g->legal_moves, &seat->ctx);
+}
+
+static inline int write_move(char *record, int length, uint_fast64_t move)
+{
+  record[length++] = 'a' + ctzll(move) % BOARD_WIDTH;
+  record[length++] = '1' + ctzll(move) / BOARD_WIDTH;
+  return length;
+}
+
+// Every adaptive seat measures every move, like adaptive_player does.
+void tell_seats(Seat *seats, int mover, uint_fast64_t move)
+{
+  for (int s = 0; s < 2; s++)
+  {
+    if (seats[s].engine->strategy == ADAPTIVE)
+      update_heuristic(&seats[s].measure, move, s != mover);
+  }
+}
+
+// The same random opening for both games of a pair, whichever thread plays them.
+// The seats see its moves as if they had been played in the game.
+// Writes its moves to record and returns how long record is then.
+int opening(Arena *arena, int pair, Game *g, char *record, Seat *seats, Players first_plays)
+{
+  unsigned state = arena->seed + pair * 0x9E3779B9u;
+  int length = 0;
+
+  *g = init_game(BLACK);
+  for (int ply = 0; ply < arena->plies && g->legal_moves; ply++)
+  {
+    state = state * 1103515245u + 12345u;
+    int pick = (state >> 16) % popcountll(g->legal_moves);
+    uint_fast64_t moves = g->legal_moves;
+
+    while (pick--)
+      moves &= moves - 1;
+    tell_seats(seats, g->current_player == first_plays ? 0 : 1, moves & -moves);
+    length = write_move(record, length, moves & -moves);
+    execute_move(g, moves & -moves);
+    if (!g->legal_moves)
+      switch_stones(g);
+  }
+
+  return length;
+}
+
+// Plays game number i from its opening, the second game of a pair with swapped sides.
+// Returns the first engine's disc difference and writes the moves to record.
+int play_game(Arena *arena, Seat *seats, int i, char *record)
+{
+  Game g;
+  Players first_plays = i % 2 ? WHITE : BLACK;
+
+  new_game(&seats[0]);
+  new_game(&seats[1]);
+  int length = opening(arena, i / 2, &g, record, seats, first_plays);
+
+  while (g.legal_moves)
+  {
+    int mover = g.current_player == first_plays ? 0 : 1;
+    uint_fast64_t move = choose_move(&seats[mover], &g, arena->move_time);
+
+    // A broken engine loses its move rather than the whole arena.
+    if (!(move & g.legal_moves))
+      move = g.legal_moves & -g.legal_moves;
+
+    tell_seats(seats, mover, move);
+    length = write_move(record, length, move);
+    execute_move(&g, move);
+    if (!g.legal_moves)
+      switch_stones(&g);
+  }
+  record[length] = '\0';
+
+  return popcountll(g.board[first_plays]) - popcountll(g.board[!first_plays]);
+}
+
+// SCORES
+// Elo from the share of points the first engine got, and the error of that share.
+
+static inline double elo(double score)
+{
+  return -400 * log10(1 / score - 1);
+}
+
+typedef struct Standings
+{
+  int games;
+  double score;    // Points per game of the first engine
+  double variance; // Of the points of a single game
+  double elo, elo_error;
+  double llr, lower, upper; // SPRT log likelihood ratio and where it decides
+} Standings;
+
+Standings standings(Arena *arena)
+{
+  Standings s = {.games = arena->wins + arena->draws + arena->losses};
+  double n = s.games;
+
+  s.lower = log(SPRT_BETA / (1 - SPRT_ALPHA));
+  s.upper = log((1 - SPRT_BETA) / SPRT_ALPHA);
+  if (!s.games)
+    return s;
+
+  s.score = (arena->wins + 0.5 * arena->draws) / n;
+  s.variance = (arena->wins * pow(1 - s.score, 2) + arena->draws * pow(0.5 - s.score, 2) +
+                arena->losses * pow(s.score, 2)) / n;
+
+  // Nobody ever won or lost every single game.
+  double score = fmin(fmax(s.score, 0.5 / n), 1 - 0.5 / n);
+  double error = 1.96 * sqrt(s.variance / n);
+  s.elo = elo(score);
+  s.elo_error = (elo(fmin(score + error, 1 - 0.5 / n)) - elo(fmax(score - error, 0.5 / n))) / 2;
+
+  // The usual approximation of the trinomial GSPRT: normal with the variance we saw.
+  if (s.variance > 0)
+  {
+    double s0 = 1 / (1 + pow(10, -arena->elo0 / 400)), s1 = 1 / (1 + pow(10, -arena->elo1 / 400));
+    s.llr = n * (s1 - s0) * (2 * s.score - s0 - s1) / (2 * s.variance);
+  }
+
+  return s;
+}
+
+void report(Arena *arena, FILE *out)
+{
+  Standings s = standings(arena);
+
+  fprintf(out, "%s vs %s: %d games, +%d =%d -%d, score %.3f, Elo %+.1f +- %.1f, LLR %.2f [%.2f, %.2f] for [%g, %g]%s\n",
+          arena->engines[0].name, arena->engines[1].name, s.games, arena->wins, arena->draws, arena->losses,
+          s.score, s.elo, s.elo_error, s.llr, s.lower, s.upper, arena->elo0, arena->elo1,
+          s.llr >= s.upper ? ", H1 accepted" : s.llr <= s.lower ? ", H0 accepted" : "");
+  fflush(out);
+}
+
+void *arena_worker(void *arg)
+{
+  Arena *arena = arg;
+  Seat seats[2];
+  char record[RECORD_LENGTH];
+
+  for (int s = 0; s < 2; s++)
+  {
+    Engine *e = &arena->engines[s];
+    // Just like the players choose for themselves, see their main.
+    bool patterns = e->strategy == HEURISTIC || arena->learned;
+    SearchContext ctx = {.evaluation = e->strategy == HEURISTIC ? heuristic_player_evaluate
+                                       : arena->learned         ? learned_evaluate
+                                                                : adaptive_player_evaluate,
+                         .probcut = patterns ? &pattern_probcut[0][0][0] : &bins_probcut[0][0][0],
+                         .endgame_empties = e->endgame_empties,
+                         .threads = 1,
+                         .max_depth = e->depth};
+    seats[s].engine = e;
+    seats[s].tt = tt_create(arena->hash_mb);
+    seats[s].ctx = ctx;
+    seats[s].ctx.tt = &seats[s].tt;
+    if (e->strategy == ADAPTIVE)
+      seats[s].ctx.eval_data = &seats[s].measure;
+  }
+
+  while (true)
+  {
+    pthread_mutex_lock(&arena->lock);
+    int i = arena->decided || arena->next >= arena->games ? -1 : arena->next++;
+    pthread_mutex_unlock(&arena->lock);
+    if (i < 0)
+      break;
+
+    int difference = play_game(arena, seats, i, record);
+
+    pthread_mutex_lock(&arena->lock);
+    arena->wins += difference > 0;
+    arena->draws += difference == 0;
+    arena->losses += difference < 0;
+    arena->played++;
+    if (arena->records)
+      fprintf(arena->records, "%s\n", record);
+    if (arena->played % REPORT_GAMES == 0)
+      report(arena, stdout);
+    if (arena->sprt)
+    {
+      Standings s = standings(arena);
+      arena->decided = s.llr >= s.upper || s.llr <= s.lower;
+    }
+    pthread_mutex_unlock(&arena->lock);
+  }
+
+  tt_free(&seats[0].tt);
+  tt_free(&seats[1].tt);
+  return NULL;
+}
+
+void arena_usage(char *name)
+{
+  fprintf(stderr, "usage: %s [-n games] [-j threads] [-p opening plies] [-S seed] [-t move ms] [-H hash MB] "
+                  "[-w weights] [-s elo0,elo1] [-r records] engine engine\n"
+                  "engines are name[:depth[:endgame empties]], name is heuristic or adaptive\n",
+          name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  Arena arena = {.games = ARENA_GAMES, .plies = ARENA_PLIES, .seed = time(NULL), .hash_mb = ARENA_HASH, .elo1 = 5};
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *weights = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:j:p:S:t:H:w:s:r:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      arena.games = atoi(optarg);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'p':
+      arena.plies = atoi(optarg);
+      break;
+    case 'S':
+      arena.seed = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      arena.move_time = atof(optarg);
+      break;
+    case 'H':
+      arena.hash_mb = atol(optarg);
+      break;
+    case 'w':
+      weights = optarg;
+      break;
+    case 's':
+      arena.sprt = true;
+      if (sscanf(optarg, "%lf,%lf", &arena.elo0, &arena.elo1) != 2 || arena.elo0 >= arena.elo1)
+        arena_usage(argv[0]);
+      break;
+    case 'r':
+      arena.records = fopen(optarg, "a");
+      if (!arena.records)
+      {
+        fprintf(stderr, "Could not open %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      arena_usage(argv[0]);
+    }
+  }
+
+  if (argc - optind != 2 || !parse_engine(argv[optind], &arena.engines[0]) || !parse_engine(argv[optind + 1], &arena.engines[1]) ||
+      arena.games < 1 || threads < 1 || arena.plies < 0 || arena.move_time < 0 || arena.hash_mb < 1 || arena.hash_mb > TT_MAX_SIZE)
+    arena_usage(argv[0]);
+
+  init_zobrist();
+  init_dispatch();
+  init_patterns();
+  init_features();
+  if (weights && !load_weights(weights))
+    return EXIT_FAILURE;
+  arena.learned = weights;
+
+  // The engines talk a lot on stderr, which would bury the standings.
+  fprintf(stderr, "Seed %u\n", arena.seed);
+  if (!freopen("/dev/null", "w", stderr))
+    return EXIT_FAILURE;
+
+  pthread_mutex_init(&arena.lock, NULL);
+  pthread_t *pool = malloc(threads * sizeof(*pool));
+  int started = 0;
+
+  while (started < threads - 1 && !pthread_create(&pool[started], NULL, arena_worker, &arena))
+    started++;
+  arena_worker(&arena);
+  for (int i = 0; i < started; i++)
+    pthread_join(pool[i], NULL);
+
+  report(&arena, stdout);
+  if (arena.records)
+    fclose(arena.records);
+  free(pool);
+  return EXIT_SUCCESS;
+}
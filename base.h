@@ -0,0 +1,495 @@
+#ifndef BASE_H
+#define BASE_H
+
+#include "definitions.h"
+#include "simd.h"
+#include "outflank.h"
+#include "timer.h"
+
+// Everything in here is shared by both players: the bitboard mechanics and
+// a few helpers for printing. Strategy specific code stays in the player files.
+
+// todo: Remove struct Position as it is not necessary
+static inline Position make_position(int x, int y)
+{
+  Position p = {x, y};
+  return p;
+}
+
+void print_position(Position p)
+{
+  fprintf(stderr, "%c%d\n", p.x + 'a', p.y + 1);
+}
+
+// This makes "curling" (or everything involving coordinates) more beautiful
+// Bitshifting with negative shift values is scary because undefined, so we need two cases.
+uint_fast64_t bitshift(uint_fast64_t left_value, short shift_count)
+{
+  if (shift_count < 0)
+    return left_value >> -shift_count;
+  else
+    return left_value <<= shift_count;
+}
+
+// We slide all our stones into a certain direction. They only slide as far as rows of enemy stones carry them.
+// Stones that are not protected by enemy stones will just vanish, as will those next to a specific edge.
+uint_fast64_t curling(Game *g, uint_fast64_t edge, short direction)
+{
+  // We blank out the fields for the edge of whatever direction we are going to
+  // since we can't set stones beyond the edge.
+  uint_fast64_t non_edge_set = g->board[!(g->current_player)] & edge;
+
+  // Now we shift the current player's stones in one direction
+  // If we encounter an enemy stone, there might be a possible turn.
+  // Otherwise said stone will vanish.
+  uint_fast64_t possible = non_edge_set & (bitshift(g->board[g->current_player], direction));
+
+  // We're a doing that eight times (since it is a 8x8 board, eh?)
+  for (int i = 0; i < 6; i++)
+  {
+    // If we continue to encounter enemy stones we move forward
+    // Otherwise we stay put wherever that stone is.
+    // (Think Pokémon ice-floor maze)
+    possible |= non_edge_set & bitshift(possible, direction);
+  }
+
+  // Now we check whether behind an enemy row there is a free spot
+  // If so, we slide our stones there and, et voila, we have possible moves.
+  // Otherwise, we discard that move candidate.
+  possible = (empty(g) & bitshift(possible, direction));
+
+  return possible;
+}
+
+// The moves that open up in one direction and its opposite at once.
+// This is curling done as a parallel prefix (Kogge-Stone) fill: after two single steps,
+// every step covers two squares, so the whole line is done in four steps instead of seven.
+// shift is always a constant, so there is no branching on its sign like in bitshift.
+static inline uint_fast64_t fill_moves(uint_fast64_t mine, uint_fast64_t theirs, const int shift)
+{
+  uint_fast64_t forward = theirs & (mine << shift);
+  uint_fast64_t backward = theirs & (mine >> shift);
+
+  forward |= theirs & (forward << shift);
+  backward |= theirs & (backward >> shift);
+
+  // Pairs of enemy stones next to each other let us jump two squares at once.
+  uint_fast64_t pairs_forward = theirs & (theirs << shift);
+  uint_fast64_t pairs_backward = pairs_forward >> shift;
+
+  forward |= pairs_forward & (forward << 2 * shift);
+  backward |= pairs_backward & (backward >> 2 * shift);
+  forward |= pairs_forward & (forward << 2 * shift);
+  backward |= pairs_backward & (backward >> 2 * shift);
+
+  return (forward << shift) | (backward >> shift);
+}
+
+// All moves mine has against theirs, for all eight directions.
+// Sideways the enemy stones on both edges can't be enclosed, which also stops wrapping around.
+static inline uint_fast64_t get_moves_scalar(uint_fast64_t mine, uint_fast64_t theirs)
+{
+  uint_fast64_t inner = theirs & ERIGHT;
+
+  return (fill_moves(mine, inner, DRIGHT) |
+          fill_moves(mine, theirs, DOWN) |
+          fill_moves(mine, inner, DOWN_LEFT) |
+          fill_moves(mine, inner, DOWN_RIGHT)) &
+         ~(mine | theirs);
+}
+
+// Set to the fastest version the CPU supports by init_dispatch.
+uint_fast64_t (*get_moves_impl)(uint_fast64_t mine, uint_fast64_t theirs) = get_moves_scalar;
+
+static inline uint_fast64_t get_moves(uint_fast64_t mine, uint_fast64_t theirs)
+{
+  return get_moves_impl(mine, theirs);
+}
+
+// Computes all possible moves on the board for eight directions
+uint_fast64_t possible_moves(Game *g)
+{
+  return get_moves(g->board[g->current_player], g->board[!(g->current_player)]);
+}
+
+// The way we used to compute possible_moves: curling one direction after the other.
+// Way slower, but easy to follow, so perft and the benchmarks check get_moves against it.
+uint_fast64_t possible_moves_curling(Game *g)
+{
+  uint_fast64_t moves = 0;
+
+  // curling only works for one direction
+  // So we do that eight times
+  moves |= curling(g, BOTTOM, DOWN);
+  moves |= curling(g, ERIGHT, DRIGHT);
+  moves |= curling(g, BOTTOM_RIGHT, DOWN_RIGHT);
+  moves |= curling(g, BOTTOM_LEFT, DOWN_LEFT);
+  moves |= curling(g, UPPER, UP);
+  moves |= curling(g, ELEFT, DLEFT);
+  moves |= curling(g, UPPER_RIGHT, UP_RIGHT);
+  moves |= curling(g, UPPER_LEFT, UP_LEFT);
+
+  return moves;
+}
+
+// ZOBRIST HASHING
+// Every (player, square) pair gets a random key and a board hashes to the XOR
+// of the keys of all its stones. Setting or flipping a stone is just another XOR.
+
+uint64_t zobrist[2][BOARD_WIDTH * BOARD_HEIGHT];
+uint64_t zobrist_flip[BOARD_WIDTH * BOARD_HEIGHT]; // Turns a stone of one player into one of the other
+uint64_t zobrist_white_to_move;
+
+// splitmix64, so the keys don't depend on whatever srand the referee sends us.
+static inline uint64_t next_random(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+// Has to be called once before the first game is set up.
+void init_zobrist(void)
+{
+  uint64_t state = 0x5265766572736921; // == "Reversi!"
+
+  for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+  {
+    zobrist[BLACK][i] = next_random(&state);
+    zobrist[WHITE][i] = next_random(&state);
+    zobrist_flip[i] = zobrist[BLACK][i] ^ zobrist[WHITE][i];
+  }
+  zobrist_white_to_move = next_random(&state);
+}
+
+// Computes the hash from scratch. Afterwards true_reverse and switch_stones keep it up to date.
+uint64_t hash_game(Game *g)
+{
+  uint64_t hash = g->current_player == WHITE ? zobrist_white_to_move : 0;
+
+  for (Players p = BLACK; p <= WHITE; p++)
+  {
+    for (uint_fast64_t stones = g->board[p]; stones; stones &= stones - 1)
+      hash ^= zobrist[p][ctzll(stones)];
+  }
+
+  return hash;
+}
+
+// The hash after side set a stone on move that flipped the stones in flipped.
+// It is the other player's turn then.
+static inline uint64_t hash_after(uint64_t hash, Players side, uint_fast64_t move, uint_fast64_t flipped)
+{
+  hash ^= zobrist[side][ctzll(move)] ^ zobrist_white_to_move;
+  for (; flipped; flipped &= flipped - 1)
+    hash ^= zobrist_flip[ctzll(flipped)];
+
+  return hash;
+}
+
+// Initialize the board such that it looks like this if printed:
+//  |A|B|C|D|E|F|G|H|
+// 1|_|_|_|_|_|_|_|_|
+// 2|_|_|_|_|_|_|_|_|
+// 3|_|_|_|_|_|_|_|_|
+// 4|_|_|_|O|X|_|_|_|
+// 5|_|_|_|X|O|_|_|_|
+// 6|_|_|_|_|_|_|_|_|
+// 7|_|_|_|_|_|_|_|_|
+// 8|_|_|_|_|_|_|_|_|
+Game init_game(Players current_player)
+{
+  Game g;
+  g.current_player = current_player;
+  g.board[BLACK] = 0x810000000;  // Replace with actual magic bit pattern 0x810000000
+  g.board[WHITE] = 0x1008000000; // For maximum beauty 0x1008000000
+  g.legal_moves = possible_moves(&g);
+  g.hash = hash_game(&g);
+
+  return g;
+}
+
+void print_row(Game *g, int row)
+{
+  // Printing the head row
+  if (row == 0)
+    fprintf(stderr, " |A|B|C|D|E|F|G|H|\n");
+  // Printing a "normal" row
+
+  fprintf(stderr, "%i|", row + 1);
+  for (int i = 0; i < 8; i++)
+  {
+    fprintf(stderr,
+            "%c|",
+            g->board[BLACK] & field_at(i, row) ? 'X' : g->board[WHITE] & field_at(i, row) ? 'O' : '_');
+  }
+
+  fprintf(stderr, "\n");
+}
+
+// Print the board. The initial board should look like shown above.
+void print_board(Game *g)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    print_row(g, i);
+  }
+  fflush(stderr);
+}
+
+// Check whether position (x,y) is on the board.
+bool out_of_bounds(int x, int y)
+{
+  return x < 0 || x > N - 1 || y < 0 || y > N - 1;
+}
+static inline bool which_stone(char c)
+{
+  return c == 'O';
+}
+
+// If it is X's turn, then "my stone" is 'X', otherwise it is 'O'.
+static inline char my_stone(Game *g)
+{
+  return g->current_player ? 'O' : 'X';
+}
+
+static inline void switch_stones(Game *g)
+{
+  g->current_player = !g->current_player;
+  g->legal_moves = possible_moves(g);
+  g->hash ^= zobrist_white_to_move;
+}
+
+// Check whether (x,y) is a legal position to place a stone. A position is legal
+// if it is empty ('_'), is on the board, and has at least one legal direction.
+
+static inline bool legal(Game *g, int x, int y)
+{
+  return is_set(g->legal_moves, x, y);
+}
+
+// Same as reverse_dir, but for any pair of bitboards instead of a Game.
+uint_fast64_t flip_dir(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move, uint_fast64_t edge, short direction)
+{
+  uint_fast64_t non_edge_set = theirs & edge;
+
+  // This time, while we are sliding player's stone, we are effectively converting
+  // every enemy stone that is encountered
+  uint_fast64_t result = non_edge_set & (bitshift(move, direction));
+
+  for (int i = 0; i < 6; i++)
+  {
+    result |= non_edge_set & bitshift(result, direction);
+  }
+
+  // If with the last step we arrive at one of current player's stones
+  // Then we can commit our changes to the board. Otherwise, zero, niet, nada, nichts da.
+  return (mine & bitshift(result, direction)) ? result : 0;
+}
+
+uint_fast64_t reverse_dir(Game *g, uint_fast64_t move, uint_fast64_t edge, short direction)
+{
+  return flip_dir(g->board[g->current_player], g->board[!(g->current_player)], move, edge, direction);
+}
+
+// All the stones of theirs that setting a stone on move would flip.
+// Nothing changes, so this is what the endgame uses to look at moves without making them.
+uint_fast64_t flips_scalar(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move)
+{
+  uint_fast64_t result = 0;
+
+  result |= flip_dir(mine, theirs, move, BOTTOM, -DOWN);
+  result |= flip_dir(mine, theirs, move, ERIGHT, -DRIGHT);
+  result |= flip_dir(mine, theirs, move, BOTTOM_RIGHT, -DOWN_RIGHT);
+  result |= flip_dir(mine, theirs, move, BOTTOM_LEFT, -DOWN_LEFT);
+  result |= flip_dir(mine, theirs, move, UPPER, -UP);
+  result |= flip_dir(mine, theirs, move, ELEFT, -DLEFT);
+  result |= flip_dir(mine, theirs, move, UPPER_RIGHT, -UP_RIGHT);
+  result |= flip_dir(mine, theirs, move, UPPER_LEFT, -UP_LEFT);
+
+  return result;
+}
+
+// Set to the fastest version the CPU supports by init_dispatch.
+uint_fast64_t (*flips_impl)(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move) = flips_scalar;
+
+static inline uint_fast64_t flips(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move)
+{
+  return flips_impl(mine, theirs, move);
+}
+
+// How long a flipping function takes for a fixed set of made up positions, in ms.
+double time_flips(uint_fast64_t (*candidate)(uint_fast64_t, uint_fast64_t, uint_fast64_t))
+{
+  uint64_t state = 0x466C697073; // == "Flips"
+  volatile uint_fast64_t sink = 0;
+  double start = now_ms();
+
+  for (int i = 0; i < 4096; i++)
+  {
+    uint_fast64_t mine = next_random(&state) & next_random(&state);
+    uint_fast64_t theirs = next_random(&state) & ~mine;
+    uint_fast64_t move = ONE << (i & 63);
+
+    sink = sink + candidate(mine & ~move, theirs & ~move, move);
+  }
+
+  return now_ms() - start;
+}
+
+// Picks the fastest move generation and flipping this CPU can do.
+// Has to be called once at startup, before that we are stuck with the scalar versions.
+// Which way of flipping wins depends a lot on the CPU (pext is really slow on some),
+// so we simply let the candidates race each other. They all give the same results.
+void init_dispatch(void)
+{
+  uint_fast64_t (*candidates[3])(uint_fast64_t, uint_fast64_t, uint_fast64_t) = {flips_table};
+  int count = 1;
+
+  init_outflank();
+
+#if HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    get_moves_impl = get_moves_avx2;
+    candidates[count++] = flips_avx2;
+  }
+  if (__builtin_cpu_supports("bmi2"))
+    candidates[count++] = flips_pext;
+#endif
+
+  double best_time = -1;
+  for (int round = 0; round < 3; round++)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      double t = time_flips(candidates[i]);
+      if (best_time < 0 || t < best_time)
+      {
+        best_time = t;
+        flips_impl = candidates[i];
+      }
+    }
+  }
+}
+
+// Reverse the stones in all legal directions starting at (x,y).
+// May modify the state of the game.
+void true_reverse(Game *g, uint_fast64_t move)
+{
+  g->board[g->current_player] |= move;
+
+  // We are gathering the changes as results of possible turns.
+  uint_fast64_t result = flips(g->board[g->current_player], g->board[!(g->current_player)], move);
+
+  // And then we commit them to the bitboards.
+  g->board[g->current_player] |= result;
+  g->board[!(g->current_player)] ^= result;
+  g->legal_moves = possible_moves(g);
+
+  // The hash only has to learn about the stones that changed.
+  g->hash ^= zobrist[g->current_player][ctzll(move)];
+  for (; result; result &= result - 1)
+    g->hash ^= zobrist_flip[ctzll(result)];
+}
+
+// todo: First remove struct Position, then this can go as well.
+void reverse(Game *g, int x, int y)
+{
+  true_reverse(g, field_at(x, y));
+}
+
+// is this even necessary?
+// static inline int eval_cell(Game *g, int x, int y, int v)
+// {
+//   return is_set(g->board[g->current_player], x, y) ? v : is_set(g->board[!(g->current_player)], x, y) ? -v : 0;
+// }
+
+// Evaluate the value of the stones on the board for the player
+// whose current turn it is.
+//  |A|B|C|D|E|F|G|H|
+// 1|_|_|_|_|_|_|_|_|
+// 2|_|_|_|_|_|_|_|_|
+// 3|_|_|_|_|_|_|_|_|
+// 4|_|_|_|O|X|_|_|_|
+// 5|_|_|_|X|O|_|_|_|
+// 6|_|_|_|_|_|_|_|_|
+// 7|_|_|_|_|_|_|_|_|
+// 8|_|_|_|_|_|_|_|_|
+
+// Count the number of cells of the given value.
+int count_cells(Game *g, Players player)
+{
+  return popcountll(g->board[player]);
+}
+
+int eval_board(Game *g, Players us)
+{
+  int value = count_cells(g, us) - count_cells(g, !us);
+
+  return value;
+}
+
+// Sums up the tier values of all given stones. The tiers don't overlap, so
+// this is the same as adding up the tier of every single stone.
+static inline int tiered_value(uint_fast64_t stones)
+{
+  return 10 * popcountll(CORNERS & stones) +
+         popcountll(C_SPOTS & stones) +
+         popcountll(X_SPOTS & stones) +
+         popcountll(A_TIER & stones) +
+         4 * popcountll(B_TIER & stones) +
+         7 * popcountll(D_TIER & stones) +
+         5 * popcountll(E_TIER & stones) +
+         4 * popcountll(F_TIER & stones) +
+         6 * popcountll(G_TIER & stones);
+}
+
+uint_fast64_t some_move(uint_fast64_t possible)
+{
+  int count = rand() % (64 - clzll(possible));
+  count += ctzll(possible >> count);
+  return ONE << count & possible;
+}
+
+static inline void execute_move(Game *g, uint_fast64_t move)
+{
+  true_reverse(g, move);
+  switch_stones(g);
+}
+
+// BOARDS
+// The search only ever works on Boards. Making a move copies the board instead of changing it,
+// so there is nothing to undo and nothing shared between searches running side by side.
+
+// The board from the point of view of the player whose turn it is in g.
+static inline Board board_of(Game *g)
+{
+  Board b = {g->board[g->current_player], g->board[!(g->current_player)]};
+  return b;
+}
+
+// The board after setting a stone on move that flips the stones in flipped.
+// Afterwards it is the opponent's turn, so mine and theirs trade places.
+static inline Board apply_move(Board b, uint_fast64_t move, uint_fast64_t flipped)
+{
+  Board next = {b.theirs ^ flipped, b.mine | flipped | move};
+  return next;
+}
+
+// The board after setting a stone on square, which has to be a legal move.
+static inline Board make_move(Board b, int square)
+{
+  uint_fast64_t move = ONE << square;
+  return apply_move(b, move, flips(b.mine, b.theirs, move));
+}
+
+static inline Board make_pass(Board b)
+{
+  Board next = {b.theirs, b.mine};
+  return next;
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include "players.h"
+
+// MICROBENCHMARKS
+// Times the hot functions of both players one at a time on a fixed corpus of midgame positions,
+// without stdin and the referee getting in the way like they do for the duration in play().
+// Every function first runs over the corpus a few times to warm up caches and branch predictors.
+// Then every round calls it once for every position, which gives one sample of ns per call.
+// For every function we print the median and the 99th percentile of these per round means as a line
+// of JSON. They are means over the corpus, so a single slow call hardly shows in p99_round_ns.
+//
+// usage: bench [-r rounds] [-f function]
+//   -r   rounds per function, the searches always get a tenth of that
+//   -f   only run the functions whose name contains this
+
+#define CORPUS_SIZE 1024
+#define CORPUS_SEED 0x42656E6368 // == "Bench"
+#define MIN_EMPTIES 20
+#define MAX_EMPTIES 44
+#define WARMUP_ROUNDS 10
+#define ROUNDS 200
+#define BENCH_DEPTH 4 // How deep most_promising_move may search, the clock would make it useless
+
+typedef struct BenchPosition
+{
+  Game game;
+  uint_fast64_t move; // Some legal move in game
+} BenchPosition;
+
+// What the subjects may need besides the position. Every benchmark starts with a fresh one.
+// Stateful ones get a scratch copy, so whatever they do doesn't change what the others see.
+typedef struct BenchState
+{
+  SearchContext heuristic_ctx;
+  SearchContext adaptive_ctx;
+  Measure measure;
+  Measure scratch; // What update_heuristic changes
+  bool is_enemy;
+  uint64_t nodes; // Searched by the searches since the last reset
+} BenchState;
+
+typedef uint64_t (*Subject)(BenchPosition *p, BenchState *s);
+
+// The games are played at random, but always the same way.
+void build_corpus(BenchPosition *corpus)
+{
+  for (int i = 0; i < CORPUS_SIZE; i++)
+  {
+    int empties = MIN_EMPTIES + i % (MAX_EMPTIES - MIN_EMPTIES + 1);
+    Game g;
+
+    srand(CORPUS_SEED + i);
+    do
+    {
+      g = init_game(BLACK);
+      while (popcountll(empty(&g)) > empties && (g.legal_moves || (switch_stones(&g), g.legal_moves)))
+        execute_move(&g, some_move(g.legal_moves));
+
+      if (!g.legal_moves)
+        switch_stones(&g);
+    } while (!g.legal_moves); // The game ended early, try another one
+
+    corpus[i].game = g;
+    corpus[i].move = some_move(g.legal_moves);
+  }
+}
+
+uint64_t bench_curling(BenchPosition *p, BenchState *s)
+{
+  return curling(&p->game, BOTTOM_RIGHT, DOWN_RIGHT);
+}
+
+uint64_t bench_possible_moves_curling(BenchPosition *p, BenchState *s)
+{
+  return possible_moves_curling(&p->game);
+}
+
+uint64_t bench_possible_moves(BenchPosition *p, BenchState *s)
+{
+  return possible_moves(&p->game);
+}
+
+uint64_t bench_reverse_dir(BenchPosition *p, BenchState *s)
+{
+  return reverse_dir(&p->game, p->move, BOTTOM, -DOWN);
+}
+
+uint64_t bench_true_reverse(BenchPosition *p, BenchState *s)
+{
+  Game g = p->game;
+  true_reverse(&g, p->move);
+  return g.hash;
+}
+
+uint64_t bench_some_move(BenchPosition *p, BenchState *s)
+{
+  return some_move(p->game.legal_moves);
+}
+
+uint64_t bench_pattern_evaluate(BenchPosition *p, BenchState *s)
+{
+  return pattern_evaluate(board_of(&p->game));
+}
+
+uint64_t bench_feature_evaluate(BenchPosition *p, BenchState *s)
+{
+  return feature_evaluate(board_of(&p->game));
+}
+
+uint64_t bench_adaptive_player_heuristic(BenchPosition *p, BenchState *s)
+{
+  return adaptive_player_heuristic(&s->measure, p->move);
+}
+
+uint64_t bench_update_heuristic(BenchPosition *p, BenchState *s)
+{
+  s->is_enemy = !s->is_enemy;
+  update_heuristic(&s->scratch, p->move, s->is_enemy);
+  return s->scratch.bins[0];
+}
+
+uint64_t bench_heuristic_player_most_promising_move(BenchPosition *p, BenchState *s)
+{
+  uint_fast64_t move = heuristic_player_most_promising_move(&p->game, p->game.legal_moves, &s->heuristic_ctx);
+  s->nodes += s->heuristic_ctx.nodes;
+  return move;
+}
+
+uint64_t bench_adaptive_player_most_promising_move(BenchPosition *p, BenchState *s)
+{
+  uint_fast64_t move = adaptive_player_most_promising_move(&p->game, p->game.legal_moves, &s->adaptive_ctx);
+  s->nodes += s->adaptive_ctx.nodes;
+  return move;
+}
+
+typedef struct Benchmark
+{
+  const char *name;
+  Subject subject;
+  bool slow; // Gets only a tenth of the rounds
+} Benchmark;
+
+static const Benchmark BENCHMARKS[] = {
+    {"curling", bench_curling, false},
+    {"possible_moves_curling", bench_possible_moves_curling, false},
+    {"possible_moves", bench_possible_moves, false},
+    {"reverse_dir", bench_reverse_dir, false},
+    {"true_reverse", bench_true_reverse, false},
+    {"some_move", bench_some_move, false},
+    {"pattern_evaluate", bench_pattern_evaluate, false},
+    {"feature_evaluate", bench_feature_evaluate, false},
+    {"adaptive_player_heuristic", bench_adaptive_player_heuristic, false},
+    {"update_heuristic", bench_update_heuristic, false},
+    {"heuristic_player_most_promising_move", bench_heuristic_player_most_promising_move, true},
+    {"adaptive_player_most_promising_move", bench_adaptive_player_most_promising_move, true},
+};
+
+int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// One pass over the corpus, in ns per call.
+double run_round(const Benchmark *b, BenchPosition *corpus, BenchState *state)
+{
+  volatile uint64_t sink = 0; // Keeps the compiler from throwing the calls away
+  double start = now_ms();
+
+  for (int i = 0; i < CORPUS_SIZE; i++)
+    sink = sink + b->subject(&corpus[i], state);
+
+  return (now_ms() - start) * MILLION / CORPUS_SIZE;
+}
+
+int main(int argc, char **argv)
+{
+  int rounds = ROUNDS;
+  char *filter = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:f:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      rounds = atoi(optarg);
+      break;
+    case 'f':
+      filter = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r rounds] [-f function]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (rounds < 10)
+  {
+    fprintf(stderr, "We need at least 10 rounds\n");
+    return EXIT_FAILURE;
+  }
+
+  init_zobrist();
+  init_dispatch();
+  init_patterns();
+  init_features();
+
+  static BenchPosition corpus[CORPUS_SIZE];
+  build_corpus(corpus);
+
+  // Some of the subjects talk a lot on stderr, which is part of what they cost,
+  // but would bury our results.
+  if (!freopen("/dev/null", "w", stderr))
+    return EXIT_FAILURE;
+
+  BenchState state = {
+      .heuristic_ctx = {.evaluation = heuristic_player_evaluate,
+                        .probcut = &pattern_probcut[0][0][0],
+                        .threads = 1,
+                        .max_depth = BENCH_DEPTH},
+      .adaptive_ctx = {.evaluation = adaptive_player_evaluate,
+                       .probcut = &bins_probcut[0][0][0],
+                       .threads = 1,
+                       .max_depth = BENCH_DEPTH},
+  };
+  state.adaptive_ctx.eval_data = &state.measure;
+
+  double samples[rounds];
+
+  for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(*BENCHMARKS); i++)
+  {
+    const Benchmark *b = &BENCHMARKS[i];
+    int n = b->slow ? rounds / 10 : rounds;
+
+    if (filter && !strstr(b->name, filter))
+      continue;
+
+    // Starting from the same state, no benchmark depends on which ones ran before.
+    init_measure(&state.measure);
+    init_measure(&state.scratch);
+    state.is_enemy = false;
+
+    for (int r = 0; r < (b->slow ? 1 : WARMUP_ROUNDS); r++)
+      run_round(b, corpus, &state);
+
+    state.nodes = 0;
+    for (int r = 0; r < n; r++)
+      samples[r] = run_round(b, corpus, &state);
+
+    qsort(samples, n, sizeof(*samples), compare_doubles);
+
+    printf("{\"function\": \"%s\", \"calls\": %d, \"rounds\": %d, \"median_ns\": %.2f, \"p99_round_ns\": %.2f",
+           b->name, CORPUS_SIZE, n, samples[n / 2], samples[(n * 99 + 99) / 100 - 1]);
+    // How well the search orders its moves shows in how many nodes it needs for the same depth.
+    if (state.nodes)
+      printf(", \"nodes_per_call\": %.1f", (double)state.nodes / n / CORPUS_SIZE);
+    printf("}\n");
+    fflush(stdout);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "symmetry.h"
+
+// OPENING BOOK
+// Moves we worked out long before the game, so the opening costs no time at all.
+// The book is a file of fixed size entries sorted by key, which we map into memory
+// and binary search. Only the pages we actually touch are ever read from disk.
+// Positions are stored in their canonical orientation, so all eight symmetric versions
+// of a position share a single entry.
+//
+// File layout, everything little endian:
+//   8 bytes   BOOK_MAGIC
+//   n * 32    BookEntry, sorted by key
+
+#define BOOK_MAGIC 0x314B4F4F42535652 // == "RVSBOOK1"
+
+typedef struct BookEntry
+{
+  uint64_t key;    // book_key of the canonical board
+  uint64_t mine;   // The canonical board itself, so a colliding key can't fool us
+  uint64_t theirs;
+  int16_t score;   // Of the best move, seen from the player to move
+  uint8_t move;    // Best move on the canonical board, as a square index
+  uint8_t depth;   // How deep the search was that found it
+  uint32_t reserved;
+} BookEntry;
+
+_Static_assert(sizeof(BookEntry) == 32, "The book format needs 32 byte entries");
+
+typedef struct Book
+{
+  const BookEntry *entries;
+  size_t count;
+  void *map;
+  size_t size;
+} Book;
+
+// Has to stay the same forever, or every book out there breaks.
+// So no Zobrist keys here, just a fixed mix of both bitboards (splitmix64's finalizer).
+static inline uint64_t book_key(Board b)
+{
+  uint64_t z = b.mine ^ (b.theirs * 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+// Maps the book at path into memory. Without a usable book, we just play without one.
+bool book_open(Book *book, const char *path)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  book->entries = NULL;
+  book->count = 0;
+  book->map = NULL;
+
+  if (fd < 0)
+  {
+    fprintf(stderr, "Could not open the book %s\n", path);
+    return false;
+  }
+
+  if (fstat(fd, &st) || st.st_size < (off_t)sizeof(uint64_t) ||
+      (st.st_size - sizeof(uint64_t)) % sizeof(BookEntry))
+  {
+    fprintf(stderr, "%s is not a book\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    fprintf(stderr, "Could not map the book %s\n", path);
+    return false;
+  }
+
+  if (*(const uint64_t *)map != BOOK_MAGIC)
+  {
+    fprintf(stderr, "%s is not a book\n", path);
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  book->map = map;
+  book->size = st.st_size;
+  book->entries = (const BookEntry *)((const char *)map + sizeof(uint64_t));
+  book->count = (st.st_size - sizeof(uint64_t)) / sizeof(BookEntry);
+
+  return true;
+}
+
+void book_close(Book *book)
+{
+  if (book->map)
+    munmap(book->map, book->size);
+  book->map = NULL;
+  book->entries = NULL;
+  book->count = 0;
+}
+
+// The entry for the canonical board c, or NULL.
+const BookEntry *book_find(const Book *book, Board c)
+{
+  uint64_t key = book_key(c);
+  size_t low = 0, high = book->count;
+
+  while (low < high)
+  {
+    size_t middle = low + (high - low) / 2;
+    if (book->entries[middle].key < key)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  // Keys may collide, so we look at all entries with our key.
+  for (; low < book->count && book->entries[low].key == key; low++)
+  {
+    if (book->entries[low].mine == c.mine && book->entries[low].theirs == c.theirs)
+      return &book->entries[low];
+  }
+
+  return NULL;
+}
+
+// The book move for the player to move in g, or 0 if the position isn't in the book.
+uint_fast64_t book_move(const Book *book, Game *g)
+{
+  if (!book->count)
+    return 0;
+
+  int s;
+  const BookEntry *e = book_find(book, canonical_board(board_of(g), &s));
+  if (!e || e->move >= BOARD_WIDTH * BOARD_HEIGHT)
+    return 0;
+
+  uint_fast64_t move = untransform_stones(ONE << e->move, s);
+
+  // A broken book must never make us play an illegal move.
+  return move & g->legal_moves;
+}
+
+int compare_book_entries(const void *a, const void *b)
+{
+  uint64_t x = ((const BookEntry *)a)->key, y = ((const BookEntry *)b)->key;
+  return (x > y) - (x < y);
+}
+
+// Sorts the entries and writes them as a book to path. Writes to a temporary file first,
+// so a crash never leaves a broken book behind. Returns false if anything went wrong.
+bool book_write(const char *path, BookEntry *entries, size_t count)
+{
+  char temporary[4096];
+  uint64_t magic = BOOK_MAGIC;
+
+  qsort(entries, count, sizeof(*entries), compare_book_entries);
+
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *f = fopen(temporary, "wb");
+  if (!f)
+    return false;
+
+  bool written = fwrite(&magic, sizeof(magic), 1, f) == 1 &&
+                 fwrite(entries, sizeof(*entries), count, f) == count;
+  written &= !fclose(f);
+
+  return written && !rename(temporary, path);
+}
+
+#endif
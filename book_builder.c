@@ -0,0 +1,588 @@
+#include <pthread.h>
+
+#include "players.h"
+#include "book.h"
+
+// BOOK BUILDER
+// Grows the opening book by drop-out expansion, starting from the initial position.
+// Every position in the book knows its engine score and its best move that doesn't lead
+// into the book yet (the drop-out move). Scores are backed up through the book by negamax.
+// Following a move that is worse than the best one costs the difference, so every drop-out move
+// has a cost: everything lost along the way from the start plus what the move itself loses.
+// We always add the cheapest ones next, so the book grows deep along the lines that get played
+// and stays shallow where somebody would have to blunder to get there.
+//
+// The new positions are searched by all threads at once. Every now and then everything
+// is written to a state file next to the book, and starting again picks up where it left off.
+//
+// usage: book_builder [-o book] [-n positions] [-d depth] [-j threads] [-p max plies] [-w ply cost] [-c checkpoint]
+//   -o   the book to write, the state goes to <book>.state
+//   -n   stop once the book has this many positions
+//   -d   how deep every position is searched
+//   -j   threads, all cores by default
+//   -p   never add positions more than this many plies into the game
+//   -w   extra cost of every ply, higher values make the book wider and shallower
+//   -c   write a checkpoint whenever this many positions were added
+
+#define BUILDER_MAGIC 0x444C495542535652 // == "RVSBUILD"
+#define BUILD_DEPTH 8         // Default for -d
+#define BUILD_POSITIONS 10000 // Default for -n
+#define BUILD_PLIES 24        // Default for -p
+#define BUILD_CHECKPOINT 256  // Default for -c
+#define BATCH_PER_THREAD 4    // Positions every thread gets per round
+#define PLY_COST 2            // Default for -w, makes deep lines a bit more expensive so the book grows wider
+#define NO_COST INT_MAX
+
+typedef struct BuilderNode
+{
+  uint64_t mine; // The canonical board
+  uint64_t theirs;
+  int16_t eval;          // Engine score, only used when the player to move has to pass
+  int16_t dropout_score; // Score of the drop-out move
+  uint8_t dropout_move;  // On the canonical board, TT_NO_MOVE if every move leads into the book
+  uint8_t depth;
+  uint16_t reserved;
+  // Recomputed every round, the state file doesn't need them.
+  int32_t value; // Negamax over the book and the drop-out move
+  int32_t cost;  // Cheapest way to get here from the start
+} BuilderNode;
+
+typedef struct Builder
+{
+  BuilderNode *nodes;
+  size_t count;
+  size_t capacity;
+  int32_t *index; // Hash map from book_key to node, -1 for free slots
+  size_t index_mask;
+  TranspositionTable tt;
+  int depth;
+  int max_plies;
+  int ply_cost;
+} Builder;
+
+// What the search of a drop-out move found out.
+typedef struct Task
+{
+  int32_t parent;
+  bool new_child;
+  BuilderNode child;
+  BuilderNode parent_update; // The parent's next drop-out move
+} Task;
+
+static inline Board node_board(BuilderNode *n)
+{
+  Board b = {n->mine, n->theirs};
+  return b;
+}
+
+static inline int plies(Board b)
+{
+  return popcountll(b.mine | b.theirs) - 4;
+}
+
+int32_t find_node(Builder *builder, Board c)
+{
+  for (size_t i = book_key(c) & builder->index_mask;; i = (i + 1) & builder->index_mask)
+  {
+    int32_t n = builder->index[i];
+    if (n < 0 || (builder->nodes[n].mine == c.mine && builder->nodes[n].theirs == c.theirs))
+      return n;
+  }
+}
+
+// Keeps the map at most half full.
+void rebuild_index(Builder *builder)
+{
+  size_t size = 1024;
+  while (size < 2 * builder->capacity)
+    size *= 2;
+
+  free(builder->index);
+  builder->index = malloc(size * sizeof(*builder->index));
+  if (!builder->index)
+  {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(builder->index, -1, size * sizeof(*builder->index));
+  builder->index_mask = size - 1;
+
+  for (size_t n = 0; n < builder->count; n++)
+  {
+    size_t i = book_key(node_board(&builder->nodes[n])) & builder->index_mask;
+    while (builder->index[i] >= 0)
+      i = (i + 1) & builder->index_mask;
+    builder->index[i] = n;
+  }
+}
+
+void add_node(Builder *builder, BuilderNode *node)
+{
+  if (find_node(builder, node_board(node)) >= 0)
+    return;
+
+  if (builder->count == builder->capacity)
+  {
+    builder->capacity = builder->capacity ? 2 * builder->capacity : 1024;
+    builder->nodes = realloc(builder->nodes, builder->capacity * sizeof(*builder->nodes));
+    if (!builder->nodes)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    rebuild_index(builder);
+  }
+
+  builder->nodes[builder->count] = *node;
+  size_t i = book_key(node_board(node)) & builder->index_mask;
+  while (builder->index[i] >= 0)
+    i = (i + 1) & builder->index_mask;
+  builder->index[i] = builder->count++;
+}
+
+// The node reached by playing square (on the canonical board of n), or -1.
+static inline int32_t child_of(Builder *builder, Board b, int square)
+{
+  int s;
+  return find_node(builder, canonical_board(make_move(b, square), &s));
+}
+
+// SEARCHING
+// Scores are from the point of view of the player to move. We search with the heuristic player's
+// evaluation and let every thread bring its own SearchContext, only the table is shared.
+
+static inline Players side_of(Board b)
+{
+  return plies(b) & 1 ? WHITE : BLACK;
+}
+
+static inline uint64_t hash_board(Board b)
+{
+  Game g = {{b.mine, b.theirs}, 0, BLACK, 0};
+  if (side_of(b) == WHITE)
+  {
+    g.board[WHITE] = b.mine;
+    g.board[BLACK] = b.theirs;
+    g.current_player = WHITE;
+  }
+  return hash_game(&g);
+}
+
+static inline int16_t clamp_score(int score)
+{
+  return score > INT16_MAX ? INT16_MAX : score < -INT16_MAX ? -INT16_MAX : score;
+}
+
+// Looks for the best move in b that doesn't lead to a position in the book, or into excluded.
+void search_dropout(Builder *builder, BuilderNode *n, uint_fast64_t excluded, SearchContext *ctx)
+{
+  Board b = node_board(n);
+  Players side = side_of(b);
+  uint64_t hash = hash_board(b);
+  int best = -SCORE_INF;
+
+  n->dropout_move = TT_NO_MOVE;
+  n->dropout_score = 0;
+  n->depth = builder->depth;
+
+  if (plies(b) >= builder->max_plies)
+    return;
+
+  for (uint_fast64_t possible = get_moves(b.mine, b.theirs) & ~excluded; possible; possible &= possible - 1)
+  {
+    uint_fast64_t move = possible & -possible;
+    if (child_of(builder, b, ctzll(move)) >= 0)
+      continue;
+
+    uint_fast64_t flipped = flips(b.mine, b.theirs, move);
+    Board child = apply_move(b, move, flipped);
+
+    // Anything not better than the best so far only needs to be proven so.
+    int score = -negamax(child, !side, hash_after(hash, side, move, flipped), builder->depth - 1, -SCORE_INF, -best, ctx);
+    if (score > best)
+    {
+      best = score;
+      n->dropout_move = ctzll(move);
+      n->dropout_score = clamp_score(score);
+    }
+  }
+}
+
+// A position that is new to the book: its own score and its drop-out move.
+void search_node(Builder *builder, BuilderNode *n, SearchContext *ctx)
+{
+  Board b = node_board(n);
+  n->eval = clamp_score(negamax(b, side_of(b), hash_board(b), builder->depth, -SCORE_INF, SCORE_INF, ctx));
+  search_dropout(builder, n, 0, ctx);
+}
+
+// DROP-OUT EXPANSION
+
+// Negamax through the book, children first. A child always has one stone more than its parent,
+// so going from full boards to empty ones sees every child before its parents.
+void back_up(Builder *builder, int32_t *order)
+{
+  for (size_t k = builder->count; k-- > 0;)
+  {
+    BuilderNode *n = &builder->nodes[order[k]];
+    Board b = node_board(n);
+    uint_fast64_t possible = get_moves(b.mine, b.theirs);
+
+    n->value = possible ? -SCORE_INF : n->eval;
+    if (n->dropout_move != TT_NO_MOVE)
+      n->value = n->dropout_score;
+
+    for (; possible; possible &= possible - 1)
+    {
+      int32_t c = child_of(builder, b, ctzll(possible));
+      if (c >= 0 && -builder->nodes[c].value > n->value)
+        n->value = -builder->nodes[c].value;
+    }
+
+    // Every move leads into the book, but none of those positions were searched yet.
+    if (n->value == -SCORE_INF)
+      n->value = n->eval;
+  }
+}
+
+// The cheapest way from the start to every position, parents first.
+void find_costs(Builder *builder, int32_t *order)
+{
+  for (size_t k = 0; k < builder->count; k++)
+    builder->nodes[order[k]].cost = k ? NO_COST : 0;
+
+  for (size_t k = 0; k < builder->count; k++)
+  {
+    BuilderNode *n = &builder->nodes[order[k]];
+    Board b = node_board(n);
+
+    if (n->cost == NO_COST)
+      continue;
+
+    for (uint_fast64_t possible = get_moves(b.mine, b.theirs); possible; possible &= possible - 1)
+    {
+      int32_t c = child_of(builder, b, ctzll(possible));
+      if (c < 0)
+        continue;
+
+      int cost = n->cost + n->value + builder->nodes[c].value + builder->ply_cost;
+      if (cost < builder->nodes[c].cost)
+        builder->nodes[c].cost = cost;
+    }
+  }
+}
+
+int32_t *order_by_stones(Builder *builder)
+{
+  int32_t *order = malloc(builder->count * sizeof(*order));
+  size_t k = 0;
+
+  for (int stones = 4; stones <= BOARD_WIDTH * BOARD_HEIGHT; stones++)
+  {
+    for (size_t n = 0; n < builder->count; n++)
+    {
+      if (popcountll(builder->nodes[n].mine | builder->nodes[n].theirs) == stones)
+        order[k++] = n;
+    }
+  }
+
+  return order;
+}
+
+static inline int dropout_cost(Builder *builder, BuilderNode *n)
+{
+  return n->cost + n->value - n->dropout_score + builder->ply_cost;
+}
+
+// Picks the count cheapest drop-out moves. Returns how many there were.
+int pick_tasks(Builder *builder, Task *tasks, int count)
+{
+  int picked = 0;
+
+  for (size_t n = 0; n < builder->count; n++)
+  {
+    BuilderNode *node = &builder->nodes[n];
+    if (node->dropout_move == TT_NO_MOVE || node->cost == NO_COST)
+      continue;
+
+    // Insertion sort, there are only a few tasks.
+    int j = picked < count ? picked++ : count;
+    while (j > 0 && dropout_cost(builder, &builder->nodes[tasks[j - 1].parent]) > dropout_cost(builder, node))
+    {
+      if (j < count)
+        tasks[j] = tasks[j - 1];
+      j--;
+    }
+    if (j < count)
+      tasks[j].parent = n;
+  }
+
+  return picked;
+}
+
+typedef struct Batch
+{
+  Builder *builder;
+  Task *tasks;
+  int count;
+  int next;
+} Batch;
+
+void *batch_worker(void *arg)
+{
+  Batch *batch = arg;
+  Builder *builder = batch->builder;
+  SearchContext ctx = {.evaluation = heuristic_player_evaluate,
+                       .tt = &builder->tt,
+                       .probcut = &pattern_probcut[0][0][0],
+                       .threads = 1,
+                       .max_depth = builder->depth};
+  int i;
+
+  while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count)
+  {
+    Task *t = &batch->tasks[i];
+    BuilderNode *parent = &builder->nodes[t->parent];
+    int s;
+    Board child = canonical_board(make_move(node_board(parent), parent->dropout_move), &s);
+
+    // Another path may have brought the child into the book already.
+    t->new_child = find_node(builder, child) < 0;
+    if (t->new_child)
+    {
+      memset(&t->child, 0, sizeof(t->child));
+      t->child.mine = child.mine;
+      t->child.theirs = child.theirs;
+      search_node(builder, &t->child, &ctx);
+    }
+
+    // The parent needs a new drop-out move, not counting the one we just took.
+    t->parent_update = *parent;
+    search_dropout(builder, &t->parent_update, ONE << parent->dropout_move, &ctx);
+  }
+
+  return NULL;
+}
+
+// CHECKPOINTS
+
+bool save_state(Builder *builder, const char *path)
+{
+  char temporary[4096];
+  uint64_t header[2] = {BUILDER_MAGIC, builder->count};
+
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *f = fopen(temporary, "wb");
+  if (!f)
+    return false;
+
+  bool written = fwrite(header, sizeof(header), 1, f) == 1 &&
+                 fwrite(builder->nodes, sizeof(*builder->nodes), builder->count, f) == builder->count;
+  written &= !fclose(f);
+
+  return written && !rename(temporary, path);
+}
+
+bool load_state(Builder *builder, const char *path)
+{
+  uint64_t header[2];
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+
+  if (fread(header, sizeof(header), 1, f) != 1 || header[0] != BUILDER_MAGIC)
+  {
+    fprintf(stderr, "%s is not a book builder state\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint64_t i = 0; i < header[1]; i++)
+  {
+    BuilderNode n;
+    if (fread(&n, sizeof(n), 1, f) != 1)
+    {
+      fprintf(stderr, "%s is cut off\n", path);
+      exit(EXIT_FAILURE);
+    }
+    add_node(builder, &n);
+  }
+
+  fclose(f);
+  return true;
+}
+
+// The book keeps every position that has a best move, together with its backed up score.
+bool export_book(Builder *builder, const char *path)
+{
+  BookEntry *entries = malloc(builder->count * sizeof(*entries));
+  size_t count = 0;
+
+  for (size_t n = 0; n < builder->count; n++)
+  {
+    BuilderNode *node = &builder->nodes[n];
+    Board b = node_board(node);
+    int best = node->dropout_move;
+
+    if (node->dropout_move == TT_NO_MOVE || node->dropout_score < node->value)
+    {
+      best = TT_NO_MOVE;
+      for (uint_fast64_t possible = get_moves(b.mine, b.theirs); possible; possible &= possible - 1)
+      {
+        int32_t c = child_of(builder, b, ctzll(possible));
+        if (c >= 0 && -builder->nodes[c].value == node->value)
+          best = ctzll(possible);
+      }
+    }
+
+    if (best == TT_NO_MOVE)
+      continue;
+
+    BookEntry e = {book_key(b), b.mine, b.theirs, clamp_score(node->value), best, node->depth, 0};
+    entries[count++] = e;
+  }
+
+  bool written = book_write(path, entries, count);
+  free(entries);
+  return written;
+}
+
+int main(int argc, char **argv)
+{
+  const char *book = "reversi.book";
+  size_t target = BUILD_POSITIONS;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int checkpoint = BUILD_CHECKPOINT;
+  Builder builder = {NULL, 0, 0, NULL, 0, {NULL, 0, 0}, BUILD_DEPTH, BUILD_PLIES, PLY_COST};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:n:d:j:p:w:c:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      book = optarg;
+      break;
+    case 'n':
+      target = atol(optarg);
+      break;
+    case 'd':
+      builder.depth = atoi(optarg);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'p':
+      builder.max_plies = atoi(optarg);
+      break;
+    case 'w':
+      builder.ply_cost = atoi(optarg);
+      break;
+    case 'c':
+      checkpoint = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-o book] [-n positions] [-d depth] [-j threads] [-p max plies] [-w ply cost] [-c checkpoint]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (builder.depth < 1 || threads < 1 || checkpoint < 1 || builder.max_plies < 1 || builder.ply_cost < 0)
+  {
+    fprintf(stderr, "All numbers have to be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  init_zobrist();
+  init_dispatch();
+  init_patterns();
+  init_features();
+  builder.tt = tt_create(TT_SIZE * threads);
+  rebuild_index(&builder);
+
+  char state[4096];
+  snprintf(state, sizeof(state), "%s.state", book);
+
+  if (load_state(&builder, state))
+    fprintf(stderr, "Resuming with %zu positions from %s\n", builder.count, state);
+  else
+  {
+    Game start = init_game(BLACK);
+    BuilderNode root = {0};
+    SearchContext ctx = {.evaluation = heuristic_player_evaluate,
+                         .tt = &builder.tt,
+                         .probcut = &pattern_probcut[0][0][0],
+                         .threads = 1,
+                         .max_depth = builder.depth};
+    int s;
+    Board c = canonical_board(board_of(&start), &s);
+
+    root.mine = c.mine;
+    root.theirs = c.theirs;
+    search_node(&builder, &root, &ctx);
+    add_node(&builder, &root);
+  }
+
+  int batch_size = threads * BATCH_PER_THREAD;
+  Task *tasks = malloc(batch_size * sizeof(*tasks));
+  pthread_t *workers = malloc(threads * sizeof(*workers));
+  size_t last_checkpoint = builder.count;
+  double start = now_ms();
+
+  while (builder.count < target)
+  {
+    int32_t *order = order_by_stones(&builder);
+    back_up(&builder, order);
+    find_costs(&builder, order);
+    free(order);
+
+    Batch batch = {&builder, tasks, pick_tasks(&builder, tasks, batch_size), 0};
+    if (!batch.count)
+    {
+      fprintf(stderr, "Nothing left to add within %d plies\n", builder.max_plies);
+      break;
+    }
+
+    // The book doesn't change while the threads search, they only read it.
+    int started = 0;
+    while (started < threads - 1 && !pthread_create(&workers[started], NULL, batch_worker, &batch))
+      started++;
+    batch_worker(&batch);
+    for (int i = 0; i < started; i++)
+      pthread_join(workers[i], NULL);
+
+    for (int i = 0; i < batch.count; i++)
+    {
+      Task *t = &tasks[i];
+      BuilderNode *parent = &builder.nodes[t->parent];
+      parent->dropout_move = t->parent_update.dropout_move;
+      parent->dropout_score = t->parent_update.dropout_score;
+      if (t->new_child)
+        add_node(&builder, &t->child);
+    }
+
+    if (builder.count - last_checkpoint >= (size_t)checkpoint || builder.count >= target)
+    {
+      if (!save_state(&builder, state) || !export_book(&builder, book))
+      {
+        fprintf(stderr, "Could not write %s\n", book);
+        return EXIT_FAILURE;
+      }
+      last_checkpoint = builder.count;
+      fprintf(stderr, "%zu positions, %.1f per second\n", builder.count, builder.count / (now_ms() - start) * 1000);
+    }
+  }
+
+  int32_t *order = order_by_stones(&builder);
+  back_up(&builder, order);
+  free(order);
+
+  if (!save_state(&builder, state) || !export_book(&builder, book))
+  {
+    fprintf(stderr, "Could not write %s\n", book);
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stderr, "Wrote %zu positions to %s\n", builder.count, book);
+  tt_free(&builder.tt);
+  return EXIT_SUCCESS;
+}
@@ -1,3 +1,6 @@
+#ifndef DEFINITIONS_H
+#define DEFINITIONS_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -14,13 +17,13 @@
 #define NANO 0.0000000001
 
 #define DEBUG 0
-#define MEASURE_TIME 1
 
 // GENERAL DEFINITIONS
 
 #define ctzll __builtin_ctzll
 #define clzll __builtin_clzll
 #define popcount __builtin_popcount
+#define popcountll __builtin_popcountll
 
 // DEFINITIONS, STRUCTS, ENUMS OF THE AI
 
@@ -30,9 +33,9 @@
 #define BOARD_WIDTH 8
 #define BOARD_HEIGHT 8
 
-#define occupied(state) ((state->board[0] | state->board[1]))
-#define empty(state) ~(occupied(state))
-#define shift_xy(x, y) (x + BOARD_WIDTH * y)
+#define occupied(state) ((state)->board[0] | (state)->board[1])
+#define empty(state) (~occupied(state))
+#define shift_xy(x, y) ((x) + BOARD_WIDTH * (y))
 #define field_at(x, y) (ONE << shift_xy(x, y))
 #define is_set(b, x, y) b &field_at(x, y)
 
@@ -54,16 +57,18 @@
 
 // #################BITMASK#################
 // BITMASK TO CONSTRUCT BOARD
+// Shifting sideways wraps around into the next row, so every direction
+// with a sideways component has to blank out both the left and the right edge.
 typedef enum Edges
 {
   BOTTOM = 0x00FFFFFFFFFFFFFF,
-  ERIGHT = 0x7F7F7F7F7F7F7F7F,
-  BOTTOM_RIGHT = 0x007F7F7F7F7F7F7F,
-  BOTTOM_LEFT = 0x00FEFEFEFEFEFEFE,
+  ERIGHT = 0x7E7E7E7E7E7E7E7E,
+  BOTTOM_RIGHT = 0x007E7E7E7E7E7E7E,
+  BOTTOM_LEFT = 0x007E7E7E7E7E7E7E,
   UPPER = 0xFFFFFFFFFFFFFF00,
-  ELEFT = 0xFEFEFEFEFEFEFEFE,
-  UPPER_RIGHT = 0x7F7F7F7F7F7F7F00,
-  UPPER_LEFT = 0xFEFEFEFEFEFEFE00
+  ELEFT = 0x7E7E7E7E7E7E7E7E,
+  UPPER_RIGHT = 0x7E7E7E7E7E7E7E00,
+  UPPER_LEFT = 0x7E7E7E7E7E7E7E00
 } Edges;
 
 // ###########DIRECTIONS########
@@ -90,19 +95,6 @@ typedef struct
 
 static inline Position make_position(int x, int y);
 
-// INPUT PARSING CONSTANTS
-
-#define DBL_POINT_SPACE_MAGIC 0x203A // == ": "
-
-// Forgive me
-#define INIT_DPS_MAGIC 0x203A74696E69     // == "init: "
-#define INIT_DPS_X_MAGIC 0x58203A74696E69 // == "init: X"
-#define INIT_DPS_O_MAGIC 0x4F203A74696E69 // == "init: O"
-
-#define SRAND_DPS_MAGIC 0x203A646E617273 // == "srand: "
-
-#define NONE_MAGIC 0x656E6F6E // == "none"
-
 #define SLICE_OF_4(bin_string) bin_string & 0xFFFFFFFF
 
 #define SLICE_OF_6(bin_string) bin_string & 0xFFFFFFFFFFFF
@@ -125,5 +117,75 @@ typedef struct Game
   uint_fast64_t board[2]; // Bitboards representing "X"/"black" and "O"/"white"
   uint_fast64_t legal_moves;
   Players current_player; // 'X' is false and 'O' is true
+  uint64_t hash;          // Zobrist hash of both bitboards and current_player
 } Game;
 
+// A position as the search sees it: the stones of the player to move and those of the opponent.
+// It is a plain value, so making a move hands back a new one and the old one stays as it was.
+typedef struct Board
+{
+  uint_fast64_t mine;
+  uint_fast64_t theirs;
+} Board;
+
+// @@@@@@@@@@@@@@@ SEARCH @@@@@@@@@@@@@@@@//
+
+#define SCORE_INF 100000
+#define SCORE_WIN 10000 // Finished games are worth more than anything a heuristic could say
+#define MAX_THREADS 64
+
+// The players bring their own evaluation. data is handed over untouched,
+// so stateful heuristics don't need globals to reach it.
+typedef int (*Evaluation)(Board b, void *data);
+
+struct TranspositionTable;
+struct Worker;
+struct ProbCut;
+
+// Where a move came from, see telemetry.h.
+typedef enum MoveSource
+{
+  SOURCE_BOOK,
+  SOURCE_PONDER,
+  SOURCE_ENDGAME, // Solved exactly
+  SOURCE_MIDGAME  // Searched with the evaluation
+} MoveSource;
+
+// What the search learned about good moves so far, see ordering.h.
+typedef struct MoveOrdering
+{
+  uint_fast64_t killers[BOARD_WIDTH * BOARD_HEIGHT][2]; // By depth left, 0 if there is none yet
+  int history[2][BOARD_WIDTH * BOARD_HEIGHT];          // By side and square
+} MoveOrdering;
+
+typedef struct SearchContext
+{
+  Evaluation evaluation;
+  void *eval_data;
+  struct TranspositionTable *tt; // May be NULL, then nothing is remembered
+  uint64_t nodes;
+  int endgame_empties; // Solve exactly once there are this many empty squares or fewer
+  double deadline;     // On the monotonic clock, 0 means no deadline
+  bool stopped;        // Set once the deadline has passed, every score after that is garbage
+  int threads;         // How many threads search the root together, see search_best_move
+  bool *abort;         // Shared by the threads of one search, set once the main thread is done
+  struct Worker *worker; // Only set while the endgame is solved in parallel
+  int max_depth;       // Never search deeper than this many plies
+  const struct ProbCut *probcut; // The table of probcut.h for evaluation, NULL never prunes selectively
+  MoveSource source;   // What the last search_best_move was, or SOURCE_BOOK if the book knew the move
+  int depth;           // Deepest iteration the last search_best_move finished
+  uint64_t tt_probes;  // Counted like nodes
+  uint64_t tt_hits;
+  MoveOrdering ordering; // Every thread learns its own
+  uint64_t key;          // Mixed into every hash we look up, so searches whose eval_data scores differently don't share entries
+} SearchContext;
+
+typedef struct SearchResult
+{
+  uint_fast64_t move; // 0 if there is no legal move
+  int score;
+  int depth;
+  uint64_t nodes;
+} SearchResult;
+
+#endif
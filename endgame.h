@@ -0,0 +1,606 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "base.h"
+#include "timer.h"
+#include "tt.h"
+
+// ENDGAME SOLVER
+// Close to the end there are so few moves left that we can play every single game to its end.
+// Inside the solver, scores are plain disc differences (just like eval_board) seen from the player to move.
+// Only at the root and in the transposition table they are scaled like final_score.
+
+#define ENDGAME_EMPTIES 16      // Default for when the solver takes over, see -e
+#define FASTEST_FIRST_EMPTIES 7 // Above this, moves that leave the opponent few replies go first
+#define ENDGAME_TT_EMPTIES 8    // Above this, results are worth remembering
+#define EXACT_DEPTH 64          // TT depth of solved positions, deeper than any search could be
+#define MAX_MOVES 32            // There are never more legal moves than that
+#define SPLIT_EMPTIES 12        // Below this, handing out moves to other threads costs more than it saves
+
+static const uint_fast64_t QUADRANTS[4] = {0x0F0F0F0F, 0xF0F0F0F0, 0x0F0F0F0F00000000, 0xF0F0F0F000000000};
+
+typedef struct EndgameMove
+{
+  uint_fast64_t move;
+  uint_fast64_t flipped;
+  int value; // Lower is tried first
+} EndgameMove;
+
+static inline int scale_final(int difference)
+{
+  return difference > 0 ? SCORE_WIN + difference : difference < 0 ? -SCORE_WIN + difference : 0;
+}
+
+static inline int unscale_final(int score)
+{
+  return score > SCORE_WIN / 2 ? score - SCORE_WIN : score < -SCORE_WIN / 2 ? score + SCORE_WIN : score;
+}
+
+static inline int disc_difference(Board b)
+{
+  return popcountll(b.mine) - popcountll(b.theirs);
+}
+
+// The game is over, so only the disc difference counts.
+static inline int final_score(Board b)
+{
+  return scale_final(disc_difference(b));
+}
+
+// All squares in quadrants with an odd number of empty squares. Whoever sets into such a quadrant
+// first can usually also set the last stone in it, so we try those moves first.
+static inline uint_fast64_t odd_quadrants(uint_fast64_t empty)
+{
+  uint_fast64_t odd = 0;
+
+  for (int i = 0; i < 4; i++)
+  {
+    if (popcountll(empty & QUADRANTS[i]) & 1)
+      odd |= QUADRANTS[i];
+  }
+
+  return odd;
+}
+
+// Only one empty square left. Whoever can set there sets the last stone.
+static inline int solve_1(Board b, int square, SearchContext *ctx)
+{
+  int difference = disc_difference(b);
+  uint_fast64_t move = ONE << square;
+  uint_fast64_t flipped;
+
+  ctx->nodes++;
+
+  if ((flipped = flips(b.mine, b.theirs, move)))
+    return difference + 2 * popcountll(flipped) + 1;
+  if ((flipped = flips(b.theirs, b.mine, move)))
+    return difference - 2 * popcountll(flipped) - 1;
+
+  return difference;
+}
+
+// Two to four empty squares left. Instead of generating moves we just try every empty square,
+// in the order they are given in (odd quadrants first).
+int solve_small(Board b, int alpha, int beta, const int *squares, int count, bool passed, SearchContext *ctx)
+{
+  if (count == 1)
+    return solve_1(b, squares[0], ctx);
+  if (count == 0)
+    return disc_difference(b);
+
+  ctx->nodes++;
+
+  int best_score = -SCORE_INF;
+
+  for (int i = 0; i < count; i++)
+  {
+    uint_fast64_t move = ONE << squares[i];
+    uint_fast64_t flipped = flips(b.mine, b.theirs, move);
+    if (!flipped)
+      continue;
+
+    int rest[4];
+    for (int j = 0, k = 0; j < count; j++)
+    {
+      if (j != i)
+        rest[k++] = squares[j];
+    }
+
+    int score = -solve_small(apply_move(b, move, flipped), -beta, -alpha, rest, count - 1, false, ctx);
+
+    if (score > best_score)
+    {
+      best_score = score;
+      if (score > alpha)
+        alpha = score;
+      if (alpha >= beta)
+        break;
+    }
+  }
+
+  if (best_score == -SCORE_INF)
+  {
+    if (passed)
+      return disc_difference(b);
+
+    return -solve_small(make_pass(b), -beta, -alpha, squares, count, true, ctx);
+  }
+
+  return best_score;
+}
+
+// Sorts the moves with a plain insertion sort, there are rarely more than a dozen.
+// The hash move goes first. With many empties, moves that leave the opponent few replies
+// come next (fastest first), corners counting double. Ties go to moves in odd quadrants.
+int order_endgame_moves(EndgameMove *list, Board b, uint_fast64_t possible, int hash_move, int empties)
+{
+  uint_fast64_t odd = odd_quadrants(~(b.mine | b.theirs));
+  int count = 0;
+
+  for (; possible; possible &= possible - 1)
+  {
+    EndgameMove m;
+    m.move = possible & -possible;
+    m.flipped = flips(b.mine, b.theirs, m.move);
+    m.value = (m.move & odd) ? 0 : 1;
+
+    if (ctzll(m.move) == hash_move)
+      m.value = -SCORE_INF;
+    else if (empties > FASTEST_FIRST_EMPTIES)
+    {
+      Board next = apply_move(b, m.move, m.flipped);
+      uint_fast64_t replies = get_moves(next.mine, next.theirs);
+      m.value += 4 * (popcountll(replies) + popcountll(replies & CORNERS));
+    }
+
+    int j = count++;
+    while (j > 0 && list[j - 1].value > m.value)
+    {
+      list[j] = list[j - 1];
+      j--;
+    }
+    list[j] = m;
+  }
+
+  return count;
+}
+
+// PARALLEL SOLVING
+// With more than one thread, the solver splits the tree Young Brothers Wait style:
+// the first move of a node is searched alone, since it usually decides the bounds.
+// Only after that, if some thread has nothing to do, the remaining moves become a split point.
+// Idle threads steal moves from split points and search them while the owner does the same.
+// Every thread keeps its split points on its own deque, thieves look at the oldest ones first,
+// because those have the biggest subtrees left.
+
+typedef struct SplitPoint
+{
+  pthread_mutex_t lock;
+  struct SplitPoint *parent; // The split point the owner was working for when it split
+  Board board;
+  Players side;
+  uint64_t hash;
+  EndgameMove *moves;
+  int next;  // moves[next] is the next one to hand out
+  int count;
+  int alpha;
+  int beta;
+  int best_score;
+  int best_move;
+  int workers; // Threads other than the owner still searching one of the moves
+  bool cutoff; // Nothing more to search here, everything below should stop
+  bool stopped; // A thread ran out of time, so the result is garbage
+} SplitPoint;
+
+typedef struct Worker
+{
+  pthread_t thread;
+  struct Pool *pool;
+  SearchContext ctx;
+  SplitPoint *split; // The split point whose move we are searching right now, if any
+  pthread_mutex_t lock; // Guards the deque
+  SplitPoint *deque[BOARD_WIDTH * BOARD_HEIGHT]; // At most one split point per ply, oldest first
+  int size;
+} Worker;
+
+typedef struct Pool
+{
+  Worker workers[MAX_THREADS];
+  int count;
+  int idle; // Workers looking for something to do
+  bool done;
+} Pool;
+
+int split(Board b, Players side, uint64_t hash, int alpha, int beta, int best_score, int *best_move,
+          EndgameMove *list, int first, int count, SearchContext *ctx);
+
+// Whether what we are searching became useless: the deadline passed
+// or one of the split points we are working for has a cutoff.
+static inline bool aborted(SearchContext *ctx)
+{
+  if (ctx->stopped)
+    return true;
+
+  if (ctx->worker)
+  {
+    for (SplitPoint *sp = ctx->worker->split; sp; sp = sp->parent)
+    {
+      if (__atomic_load_n(&sp->cutoff, __ATOMIC_RELAXED))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+// Exact search of a position with more than four empty squares.
+// side and hash belong to the player to move, we need them for the transposition table.
+int solve(Board b, Players side, uint64_t hash, int alpha, int beta, bool passed, SearchContext *ctx)
+{
+  uint_fast64_t empty = ~(b.mine | b.theirs);
+  int empties = popcountll(empty);
+
+  if (empties <= 4)
+  {
+    int squares[4];
+    int count = 0;
+    uint_fast64_t odd = odd_quadrants(empty);
+
+    for (uint_fast64_t e = empty & odd; e; e &= e - 1)
+      squares[count++] = ctzll(e);
+    for (uint_fast64_t e = empty & ~odd; e; e &= e - 1)
+      squares[count++] = ctzll(e);
+
+    return solve_small(b, alpha, beta, squares, count, passed, ctx);
+  }
+
+  ctx->nodes++;
+
+  if (time_is_up(ctx))
+    return 0;
+
+  uint_fast64_t possible = get_moves(b.mine, b.theirs);
+
+  if (!possible)
+  {
+    if (passed)
+      return disc_difference(b);
+
+    return -solve(make_pass(b), !side, hash ^ zobrist_white_to_move, -beta, -alpha, true, ctx);
+  }
+
+  int original_alpha = alpha;
+  int hash_move = TT_NO_MOVE;
+  bool use_tt = ctx->tt && empties > ENDGAME_TT_EMPTIES;
+  TTHit hit;
+
+  if (use_tt && tt_lookup(ctx, hash, &hit))
+  {
+    if (hit.depth >= EXACT_DEPTH)
+    {
+      int score = unscale_final(hit.score);
+      if (hit.bound == BOUND_EXACT ||
+          (hit.bound == BOUND_LOWER && score >= beta) ||
+          (hit.bound == BOUND_UPPER && score <= alpha))
+        return score;
+    }
+    hash_move = hit.move;
+  }
+
+  EndgameMove list[MAX_MOVES];
+  int count = order_endgame_moves(list, b, possible, hash_move, empties);
+  int best_score = -SCORE_INF;
+  int best_move = TT_NO_MOVE;
+
+  for (int i = 0; i < count; i++)
+  {
+    // The first move is searched, so the others may go to idle threads.
+    if (i == 1 && ctx->worker && empties >= SPLIT_EMPTIES &&
+        __atomic_load_n(&ctx->worker->pool->idle, __ATOMIC_RELAXED))
+    {
+      best_score = split(b, side, hash, alpha, beta, best_score, &best_move, list, i, count, ctx);
+      if (aborted(ctx))
+        return 0;
+      break;
+    }
+
+    Board next = apply_move(b, list[i].move, list[i].flipped);
+    uint64_t next_hash = hash_after(hash, side, list[i].move, list[i].flipped);
+
+    int score;
+    if (i == 0)
+      score = -solve(next, !side, next_hash, -beta, -alpha, false, ctx);
+    else
+    {
+      score = -solve(next, !side, next_hash, -alpha - 1, -alpha, false, ctx);
+      if (score > alpha && score < beta)
+        score = -solve(next, !side, next_hash, -beta, -alpha, false, ctx);
+    }
+
+    if (aborted(ctx))
+      return 0;
+
+    if (score > best_score)
+    {
+      best_score = score;
+      best_move = ctzll(list[i].move);
+      if (score > alpha)
+        alpha = score;
+      if (alpha >= beta)
+        break;
+    }
+  }
+
+  if (use_tt)
+  {
+    Bound bound = best_score <= original_alpha ? BOUND_UPPER : best_score >= beta ? BOUND_LOWER : BOUND_EXACT;
+    tt_store(ctx->tt, hash, scale_final(best_score), best_move, EXACT_DEPTH, bound);
+  }
+
+  return best_score;
+}
+
+// Solves the game from b on and returns the best move with its scaled final score.
+// first_move is tried first. If the deadline passes, ctx->stopped is set and the result is garbage.
+SearchResult solve_root(Board b, Players side, uint64_t hash, uint_fast64_t first_move, SearchContext *ctx)
+{
+  int empties = popcountll(~(b.mine | b.theirs));
+  SearchResult result = {0, -SCORE_INF, empties, 0};
+  int alpha = -BOARD_WIDTH * BOARD_HEIGHT - 1;
+  int beta = BOARD_WIDTH * BOARD_HEIGHT + 1;
+
+  ctx->nodes++;
+
+  EndgameMove list[MAX_MOVES];
+  int count = order_endgame_moves(list, b, get_moves(b.mine, b.theirs), first_move ? ctzll(first_move) : TT_NO_MOVE, empties);
+
+  for (int i = 0; i < count; i++)
+  {
+    if (i == 1 && ctx->worker)
+    {
+      int best_move = ctzll(result.move);
+      int best_score = split(b, side, hash, alpha, beta, alpha, &best_move, list, i, count, ctx);
+      if (!ctx->stopped && best_score > alpha)
+      {
+        alpha = best_score;
+        result.move = ONE << best_move;
+      }
+      break;
+    }
+
+    Board next = apply_move(b, list[i].move, list[i].flipped);
+    uint64_t next_hash = hash_after(hash, side, list[i].move, list[i].flipped);
+
+    int score;
+    if (i == 0)
+      score = -solve(next, !side, next_hash, -beta, -alpha, false, ctx);
+    else
+    {
+      score = -solve(next, !side, next_hash, -alpha - 1, -alpha, false, ctx);
+      if (score > alpha)
+        score = -solve(next, !side, next_hash, -beta, -alpha, false, ctx);
+    }
+
+    if (ctx->stopped)
+      break;
+
+    if (score > alpha)
+    {
+      alpha = score;
+      result.move = list[i].move;
+    }
+  }
+
+  result.score = scale_final(alpha);
+
+  return result;
+}
+
+// Searches one move of a split point and adds its score to it.
+// alpha is the split point's alpha from when we took the move.
+void search_split_move(SplitPoint *sp, int i, int alpha, SearchContext *ctx)
+{
+  SplitPoint *outer = ctx->worker->split;
+  EndgameMove *m = &sp->moves[i];
+  Board next = apply_move(sp->board, m->move, m->flipped);
+  uint64_t next_hash = hash_after(sp->hash, sp->side, m->move, m->flipped);
+
+  ctx->worker->split = sp;
+
+  int score = -solve(next, !sp->side, next_hash, -alpha - 1, -alpha, false, ctx);
+  if (score > alpha && score < sp->beta && !aborted(ctx))
+    score = -solve(next, !sp->side, next_hash, -sp->beta, -alpha, false, ctx);
+
+  pthread_mutex_lock(&sp->lock);
+  if (ctx->stopped)
+  {
+    sp->stopped = true;
+    __atomic_store_n(&sp->cutoff, true, __ATOMIC_RELAXED);
+  }
+  else if (!aborted(ctx) && score > sp->best_score)
+  {
+    sp->best_score = score;
+    sp->best_move = ctzll(m->move);
+    if (score > sp->alpha)
+      sp->alpha = score;
+    if (sp->alpha >= sp->beta)
+      __atomic_store_n(&sp->cutoff, true, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&sp->lock);
+
+  ctx->worker->split = outer;
+}
+
+// Hands out the next move of sp, if there is one left. Returns its index or -1.
+static inline int take_move(SplitPoint *sp, int *alpha)
+{
+  int i = -1;
+
+  pthread_mutex_lock(&sp->lock);
+  if (sp->next < sp->count && !sp->cutoff)
+  {
+    i = sp->next++;
+    *alpha = sp->alpha;
+  }
+  pthread_mutex_unlock(&sp->lock);
+
+  return i;
+}
+
+// Searches list[first] to list[count - 1] together with whoever is idle and returns
+// the best score among them and best_score. best_move is updated if one of them is better.
+// alpha has to include the moves that were already searched.
+int split(Board b, Players side, uint64_t hash, int alpha, int beta, int best_score, int *best_move,
+          EndgameMove *list, int first, int count, SearchContext *ctx)
+{
+  Worker *self = ctx->worker;
+  SplitPoint sp = {.parent = self->split, .board = b, .side = side, .hash = hash,
+                   .moves = list, .next = first, .count = count, .alpha = alpha, .beta = beta,
+                   .best_score = best_score, .best_move = *best_move};
+  pthread_mutex_init(&sp.lock, NULL);
+
+  pthread_mutex_lock(&self->lock);
+  self->deque[self->size++] = &sp;
+  pthread_mutex_unlock(&self->lock);
+
+  int i;
+  while ((i = take_move(&sp, &alpha)) >= 0)
+    search_split_move(&sp, i, alpha, ctx);
+
+  // Nobody may take moves from here anymore, since sp is gone once we return.
+  pthread_mutex_lock(&self->lock);
+  self->size--;
+  pthread_mutex_unlock(&self->lock);
+
+  // The others are still busy with their moves. Waiting for them beats starting
+  // something new that might keep us from returning for a long time.
+  while (true)
+  {
+    pthread_mutex_lock(&sp.lock);
+    int workers = sp.workers;
+    pthread_mutex_unlock(&sp.lock);
+    if (!workers)
+      break;
+    sched_yield();
+  }
+
+  if (sp.stopped)
+    ctx->stopped = true;
+
+  *best_move = sp.best_move;
+  pthread_mutex_destroy(&sp.lock);
+
+  return sp.best_score;
+}
+
+// Looks through the deques of all other workers for a move to search.
+bool steal(Worker *self)
+{
+  Pool *pool = self->pool;
+  int start = self - pool->workers;
+
+  for (int k = 1; k < pool->count; k++)
+  {
+    Worker *victim = &pool->workers[(start + k) % pool->count];
+    SplitPoint *sp = NULL;
+    int i = -1;
+    int alpha;
+
+    pthread_mutex_lock(&victim->lock);
+    for (int j = 0; j < victim->size && i < 0; j++)
+    {
+      sp = victim->deque[j];
+      if ((i = take_move(sp, &alpha)) >= 0)
+      {
+        // Counted while the deque is locked, so the owner waits for us.
+        pthread_mutex_lock(&sp->lock);
+        sp->workers++;
+        pthread_mutex_unlock(&sp->lock);
+      }
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (i >= 0)
+    {
+      __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+      search_split_move(sp, i, alpha, &self->ctx);
+      __atomic_add_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+
+      pthread_mutex_lock(&sp->lock);
+      sp->workers--;
+      pthread_mutex_unlock(&sp->lock);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void *worker_loop(void *arg)
+{
+  Worker *self = arg;
+  Pool *pool = self->pool;
+
+  __atomic_add_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+  while (!__atomic_load_n(&pool->done, __ATOMIC_RELAXED))
+  {
+    if (steal(self))
+      continue;
+    sched_yield();
+  }
+  __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+
+  return NULL;
+}
+
+// solve_root with ctx->threads threads splitting the tree between them.
+SearchResult solve_root_parallel(Board b, Players side, uint64_t hash, uint_fast64_t first_move, SearchContext *ctx)
+{
+  Pool pool;
+  int count = ctx->threads > MAX_THREADS ? MAX_THREADS : ctx->threads;
+
+  pool.count = count;
+  pool.idle = 0;
+  pool.done = false;
+
+  for (int i = 0; i < count; i++)
+  {
+    Worker *w = &pool.workers[i];
+    w->pool = &pool;
+    w->split = NULL;
+    w->size = 0;
+    w->ctx = *ctx;
+    w->ctx.nodes = 0;
+    w->ctx.tt_probes = 0;
+    w->ctx.tt_hits = 0;
+    w->ctx.worker = w;
+    pthread_mutex_init(&w->lock, NULL);
+  }
+
+  // The main thread is worker 0. If a thread can't be started, its deque just stays empty.
+  int started = 1;
+  while (started < count && !pthread_create(&pool.workers[started].thread, NULL, worker_loop, &pool.workers[started]))
+    started++;
+
+  SearchResult result = solve_root(b, side, hash, first_move, &pool.workers[0].ctx);
+
+  __atomic_store_n(&pool.done, true, __ATOMIC_RELAXED);
+  for (int i = 1; i < started; i++)
+    pthread_join(pool.workers[i].thread, NULL);
+
+  ctx->stopped = pool.workers[0].ctx.stopped;
+  for (int i = 0; i < count; i++)
+  {
+    ctx->nodes += pool.workers[i].ctx.nodes;
+    ctx->tt_probes += pool.workers[i].ctx.tt_probes;
+    ctx->tt_hits += pool.workers[i].ctx.tt_hits;
+    pthread_mutex_destroy(&pool.workers[i].lock);
+  }
+
+  return result;
+}
+
+#endif
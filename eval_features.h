@@ -0,0 +1,173 @@
+#ifndef EVAL_FEATURES_H
+#define EVAL_FEATURES_H
+
+#include "base.h"
+#include "symmetry.h"
+
+// POSITION FEATURES
+// Things about a position that the square values can't see, all counted straight on the bitboards:
+//   stable discs     can never be flipped again, whatever anybody plays
+//   mobility         how many moves we have compared to them
+//   potential moves  empty squares next to their discs, where moves may show up later
+//   frontier         our discs next to an empty square, which give them moves
+// A corner that is about to fall shows up in these long before a stone lands on it.
+//
+// A disc is stable if it can't be flipped along any of its four lines. That's the case for a line that
+// is full, that ends at the disc, or where the disc sits next to a stable one of its own colour.
+// Edges are looked up in a table that knows every way an edge can be played out, everything else
+// grows from there until nothing changes anymore. This misses a few stable discs, but never counts
+// one that isn't.
+
+#define STABLE_SCORE 12   // Per stable disc more than they have
+#define MOBILITY_SCORE 6  // Per move more than they have
+#define POTENTIAL_SCORE 2 // Per potential move more than they have
+#define FRONTIER_SCORE 2  // Per frontier disc fewer than they have
+
+#define FILE_H 0x8080808080808080
+#define BORDER 0xFF818181818181FF
+
+// edge_stability[mine << 8 | theirs]: Our discs on an edge that no moves on it can ever flip.
+uint8_t edge_stability[256 * 256];
+// All 15 diagonals and all 15 anti diagonals, the corners included.
+uint_fast64_t diagonal_lines[30];
+
+// Has to be called once after init_dispatch, the edges are played out with its flip tables.
+void init_features(void)
+{
+  // A full edge stays as it is, so we go from full edges to empty ones:
+  // a disc is stable if it is still ours after every move anybody may make next.
+  for (int discs = BOARD_WIDTH; discs >= 0; discs--)
+  {
+    for (int mine = 0; mine < 256; mine++)
+    {
+      for (int theirs = 0; theirs < 256; theirs++)
+      {
+        if (mine & theirs || popcountll(mine | theirs) != discs)
+          continue;
+
+        uint8_t stable = mine;
+        for (int p = 0; p < BOARD_WIDTH; p++)
+        {
+          int move = 1 << p;
+          if ((mine | theirs) & move)
+            continue;
+
+          uint8_t f = flip_line(p, mine, theirs);
+          stable &= edge_stability[(mine | move | f) << 8 | (theirs & ~f)];
+          f = flip_line(p, theirs, mine);
+          stable &= edge_stability[(mine & ~f) << 8 | (theirs | move | f)];
+        }
+        edge_stability[mine << 8 | theirs] = stable;
+      }
+    }
+  }
+
+  for (int i = 0; i < BOARD_WIDTH; i++)
+  {
+    diagonal_lines[i] = diagonal[i];
+    diagonal_lines[15 + i] = anti_diagonal[i];
+  }
+  for (int i = 1; i < BOARD_HEIGHT; i++)
+  {
+    diagonal_lines[7 + i] = diagonal[i * BOARD_WIDTH];
+    diagonal_lines[22 + i] = anti_diagonal[i * BOARD_WIDTH + BOARD_WIDTH - 1];
+  }
+}
+
+// Our stable discs on all four edges. Columns become rows when transposed.
+static inline uint_fast64_t edge_stable(uint_fast64_t mine, uint_fast64_t theirs)
+{
+  uint_fast64_t mine_t = transpose(mine), theirs_t = transpose(theirs);
+  uint_fast64_t columns = edge_stability[(mine_t & 0xFF) << 8 | (theirs_t & 0xFF)] |
+                          (uint_fast64_t)edge_stability[(mine_t >> 56) << 8 | theirs_t >> 56] << 56;
+
+  return edge_stability[(mine & 0xFF) << 8 | (theirs & 0xFF)] |
+         (uint_fast64_t)edge_stability[(mine >> 56) << 8 | theirs >> 56] << 56 |
+         transpose(columns);
+}
+
+// The squares whose line in each direction can't be used to flip them anymore:
+// the line is full, or it ends at the square.
+typedef struct FullLines
+{
+  uint_fast64_t rows, columns, diagonals, anti_diagonals;
+} FullLines;
+
+static inline FullLines full_lines(uint_fast64_t occupied)
+{
+  FullLines l;
+
+  // Rows: a byte with an empty square in it ends up with a 1 in its lowest bit.
+  uint_fast64_t gaps = ~occupied;
+  gaps |= gaps >> 4 & 0x0F0F0F0F0F0F0F0F;
+  gaps |= gaps >> 2 & 0x0303030303030303;
+  gaps |= gaps >> 1 & 0x0101010101010101;
+  l.rows = ~((gaps & 0x0101010101010101) * 0xFF) | FILE_A | FILE_H;
+
+  uint_fast64_t columns = occupied;
+  columns &= columns >> 32;
+  columns &= columns >> 16;
+  columns &= columns >> 8;
+  l.columns = (columns & 0xFF) * 0x0101010101010101 | 0xFF000000000000FF;
+
+  l.diagonals = l.anti_diagonals = BORDER;
+#pragma GCC unroll 15
+  for (int i = 0; i < 15; i++)
+  {
+    l.diagonals |= (occupied & diagonal_lines[i]) == diagonal_lines[i] ? diagonal_lines[i] : 0;
+    l.anti_diagonals |= (occupied & diagonal_lines[15 + i]) == diagonal_lines[15 + i] ? diagonal_lines[15 + i] : 0;
+  }
+
+  return l;
+}
+
+static inline uint_fast64_t stable_on(uint_fast64_t mine, uint_fast64_t theirs, const FullLines *l)
+{
+  uint_fast64_t stable = edge_stable(mine, theirs) | (mine & l->rows & l->columns & l->diagonals & l->anti_diagonals);
+  uint_fast64_t before;
+
+  // Anything next to a stable disc of its own colour is safe on that line.
+  do
+  {
+    before = stable;
+    stable |= mine &
+              (l->rows | (stable << 1 & ~FILE_A) | (stable >> 1 & ~FILE_H)) &
+              (l->columns | stable << 8 | stable >> 8) &
+              (l->diagonals | (stable << 9 & ~FILE_A) | (stable >> 9 & ~FILE_H)) &
+              (l->anti_diagonals | (stable << 7 & ~FILE_H) | (stable >> 7 & ~FILE_A));
+  } while (stable != before);
+
+  return stable;
+}
+
+// The discs of mine that can never be flipped.
+uint_fast64_t stable_discs(uint_fast64_t mine, uint_fast64_t theirs)
+{
+  FullLines l = full_lines(mine | theirs);
+  return stable_on(mine, theirs, &l);
+}
+
+// All squares next to stones, in any of the eight directions.
+static inline uint_fast64_t neighbours(uint_fast64_t stones)
+{
+  uint_fast64_t sideways = (stones << 1 & ~FILE_A) | (stones >> 1 & ~FILE_H);
+  uint_fast64_t row = stones | sideways;
+  return sideways | row << 8 | row >> 8;
+}
+
+// The features for the player to move, in the same units as pattern_evaluate.
+int feature_evaluate(Board b)
+{
+  uint_fast64_t empties = ~(b.mine | b.theirs);
+  uint_fast64_t next_to_empty = neighbours(empties);
+  FullLines l = full_lines(b.mine | b.theirs);
+
+  int stable = popcountll(stable_on(b.mine, b.theirs, &l)) - popcountll(stable_on(b.theirs, b.mine, &l));
+  int mobility = popcountll(get_moves(b.mine, b.theirs)) - popcountll(get_moves(b.theirs, b.mine));
+  int potential = popcountll(neighbours(b.theirs) & empties) - popcountll(neighbours(b.mine) & empties);
+  int frontier = popcountll(b.theirs & next_to_empty) - popcountll(b.mine & next_to_empty);
+
+  return STABLE_SCORE * stable + MOBILITY_SCORE * mobility + POTENTIAL_SCORE * potential + FRONTIER_SCORE * frontier;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <unistd.h>
+
+#include "definitions.h"
+#include "timer.h"
+#include "tt.h"
+#include "endgame.h"
+#include "search.h"
+
+// COMMAND LINE OPTIONS
+// Both players understand the same ones:
+//   -t <ms>  time we may think about a single move
+//   -T <ms>  time we may think about the whole game
+//   -H <MB>  size of the transposition table
+//   -e <n>   solve the endgame exactly from n empty squares on
+//   -j <n>   search with n threads
+//   -d <n>   never search deeper than n plies, no matter how much time is left
+//   -b <file> play from this opening book as long as it knows the position
+//   -w <file> evaluate with the pattern weights learned by train.c
+//   -s       play many games at once, see server.h. -j is then how many games we search for at once
+//   -P       think on the opponent's time too, see ponder.h. Not with -s, that is a usage error
+//   -l <fd>  write a line of JSON about every move we make to this file descriptor, see telemetry.h
+
+typedef struct Options
+{
+  TimeControl tc;
+  long hash_mb; // Signed, so a negative -H is caught instead of wrapping around
+  int endgame_empties;
+  int threads;
+  int max_depth;
+  const char *book; // NULL if we play without one
+  const char *weights; // NULL if we evaluate without learned weights
+  bool server;
+  bool ponder;
+  int telemetry_fd; // -1 if nobody wants to know
+} Options;
+
+void usage(char *name)
+{
+  fprintf(stderr, "usage: %s [-t move ms] [-T game ms] [-H hash MB] [-e endgame empties] [-j threads] [-d max depth] [-b book] [-w weights] [-s] [-P] [-l fd]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+Options parse_options(int argc, char **argv)
+{
+  Options o = {{MOVE_TIME, GAME_TIME, 0}, TT_SIZE, ENDGAME_EMPTIES, 1, MAX_SEARCH_DEPTH, NULL, NULL, false, false, -1};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:T:H:e:j:d:b:w:sPl:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      o.tc.move_time = atof(optarg);
+      break;
+    case 'T':
+      o.tc.game_time = atof(optarg);
+      break;
+    case 'H':
+      o.hash_mb = atol(optarg);
+      break;
+    case 'e':
+      o.endgame_empties = atoi(optarg);
+      break;
+    case 'j':
+      o.threads = atoi(optarg);
+      break;
+    case 'd':
+      o.max_depth = atoi(optarg);
+      break;
+    case 'b':
+      o.book = optarg;
+      break;
+    case 'w':
+      o.weights = optarg;
+      break;
+    case 's':
+      o.server = true;
+      break;
+    case 'P':
+      o.ponder = true;
+      break;
+    case 'l':
+      o.telemetry_fd = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (o.tc.move_time <= 0 || o.tc.game_time <= 0 || o.hash_mb <= 0 || o.hash_mb > TT_MAX_SIZE || o.threads <= 0 ||
+      o.threads > MAX_THREADS || o.max_depth <= 0 || o.telemetry_fd < -1 || (o.server && o.ponder))
+    usage(argv[0]);
+
+  return o;
+}
+
+#endif
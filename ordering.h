@@ -0,0 +1,103 @@
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include "base.h"
+#include "endgame.h"
+
+// MOVE ORDERING
+// Alpha-beta only cuts much if the best move comes first, so every node sorts its moves by:
+//   1. the hash move, the best one the last time we were here
+//   2. how many replies the opponent gets afterwards, corners counting double (fastest first),
+//      adjusted by what kind of square it is: corners are good, the squares next to them are bad,
+//      by how often the square refuted something before (history),
+//      and by whether it is one of the two moves that recently refuted another position at the same depth (killers).
+// Killers only get a small bonus. In Reversi the same move rarely refutes two different positions,
+// and trusting them more than fastest first costs nodes.
+// Killers and history are learned while searching. Every search starts with fresh killers
+// and with the history of the last one halved, since the position moved on.
+
+#define KILLER_VALUE 64         // Worth one reply less, the second killer half of that
+#define HISTORY_MAX (1 << 14)   // Past this, the history of the side is halved
+#define HISTORY_SHIFT 6         // A history of 64 is worth one point of a move's value
+#define REPLY_VALUE 64          // Per reply the opponent gets, corners count double
+
+typedef struct OrderedMove
+{
+  uint_fast64_t move;
+  uint_fast64_t flipped;
+  int value; // Lower is tried first, just like in the solver
+} OrderedMove;
+
+static inline int square_prior(uint_fast64_t move)
+{
+  return move & CORNERS ? -64 : move & X_SPOTS ? 48 : move & C_SPOTS ? 24 : 0;
+}
+
+// Fills list with the moves in possible, sorted with a plain insertion sort. Returns how many there are.
+int order_moves(OrderedMove *list, Board b, uint_fast64_t possible, uint_fast64_t hash_move, Players side, int depth,
+                const MoveOrdering *o)
+{
+  int count = 0;
+
+  for (; possible; possible &= possible - 1)
+  {
+    OrderedMove m;
+    m.move = possible & -possible;
+    m.flipped = flips(b.mine, b.theirs, m.move);
+
+    if (m.move == hash_move)
+      m.value = -SCORE_INF;
+    else
+    {
+      Board next = apply_move(b, m.move, m.flipped);
+      uint_fast64_t replies = get_moves(next.mine, next.theirs);
+
+      m.value = REPLY_VALUE * (popcountll(replies) + popcountll(replies & CORNERS)) + square_prior(m.move) -
+                (o->history[side][ctzll(m.move)] >> HISTORY_SHIFT);
+      if (m.move == o->killers[depth][0])
+        m.value -= KILLER_VALUE;
+      else if (m.move == o->killers[depth][1])
+        m.value -= KILLER_VALUE / 2;
+    }
+
+    int j = count++;
+    while (j > 0 && list[j - 1].value > m.value)
+    {
+      list[j] = list[j - 1];
+      j--;
+    }
+    list[j] = m;
+  }
+
+  return count;
+}
+
+// move refuted the position, so it gets tried earlier from now on.
+static inline void reward_move(MoveOrdering *o, Players side, uint_fast64_t move, int depth)
+{
+  if (o->killers[depth][0] != move)
+  {
+    o->killers[depth][1] = o->killers[depth][0];
+    o->killers[depth][0] = move;
+  }
+
+  int *history = o->history[side];
+  history[ctzll(move)] += depth * depth;
+  if (history[ctzll(move)] > HISTORY_MAX)
+  {
+    for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+      history[i] /= 2;
+  }
+}
+
+void new_ordering(MoveOrdering *o)
+{
+  memset(o->killers, 0, sizeof(o->killers));
+  for (int side = 0; side < 2; side++)
+  {
+    for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+      o->history[side][i] /= 2;
+  }
+}
+
+#endif
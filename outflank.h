@@ -0,0 +1,151 @@
+#ifndef OUTFLANK_H
+#define OUTFLANK_H
+
+#include "definitions.h"
+#include "simd.h"
+
+// OUTFLANK TABLES
+// Every stone that gets flipped lies on one of the four lines through the new stone:
+// its row, its column or one of its two diagonals. We squeeze each line into a byte,
+// look up which of our stones could close it (the outflank) and which stones that flips,
+// and then spread the flipped byte back out onto the board.
+// Positions on a line are counted from 0 to 7: by column for rows and diagonals, by row for columns.
+
+#define FILE_A 0x0101010101010101
+#define FILE_TO_BYTE 0x0102040810204080 // Gathers the A file into the top byte, row 1 lowest
+#define FILES_TO_BYTE 0x0101010101010101 // Gathers one stone per file into the top byte
+
+// outflank[p][o]: The ends of the enemy runs o starting next to position p.
+// Only if one of ours is there, that run gets flipped.
+uint8_t outflank[8][256];
+// flipped[p][f]: Everything strictly between position p and the outflanking stones f.
+uint8_t flipped[8][256];
+// A byte spread over the A file, row by row.
+uint_fast64_t byte_to_file[256];
+// The two diagonals through every square: with DOWN_RIGHT and with DOWN_LEFT steps.
+uint_fast64_t diagonal[64];
+uint_fast64_t anti_diagonal[64];
+
+// Has to be called once before flips_table or flips_pext are used.
+void init_outflank(void)
+{
+  for (int p = 0; p < 8; p++)
+  {
+    for (int o = 0; o < 256; o++)
+    {
+      int q;
+      uint8_t ends = 0;
+
+      for (q = p + 1; q < 8 && o & 1 << q; q++)
+        ;
+      if (q < 8 && q > p + 1)
+        ends |= 1 << q;
+
+      for (q = p - 1; q >= 0 && o & 1 << q; q--)
+        ;
+      if (q >= 0 && q < p - 1)
+        ends |= 1 << q;
+
+      outflank[p][o] = ends;
+
+      uint8_t between = 0;
+      for (q = 0; q < 8; q++)
+      {
+        if (o & 1 << q)
+        {
+          int from = p < q ? p : q;
+          int to = p < q ? q : p;
+          between |= (0xFF >> (8 - to)) & (0xFF << (from + 1));
+        }
+      }
+      flipped[p][o] = between;
+    }
+  }
+
+  for (int b = 0; b < 256; b++)
+  {
+    byte_to_file[b] = 0;
+    for (int row = 0; row < 8; row++)
+      byte_to_file[b] |= (uint_fast64_t)(b >> row & 1) << BOARD_WIDTH * row;
+  }
+
+  for (int sq = 0; sq < 64; sq++)
+  {
+    int x = sq % BOARD_WIDTH, y = sq / BOARD_WIDTH;
+    diagonal[sq] = anti_diagonal[sq] = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+      if (i - x + y >= 0 && i - x + y < 8)
+        diagonal[sq] |= field_at(i, i - x + y);
+      if (x + y - i >= 0 && x + y - i < 8)
+        anti_diagonal[sq] |= field_at(i, x + y - i);
+    }
+  }
+}
+
+// The stones flipped on one line, as a byte. p is where the new stone goes.
+static inline uint8_t flip_line(int p, uint8_t mine, uint8_t theirs)
+{
+  return flipped[p][outflank[p][theirs] & mine];
+}
+
+// Diagonals have at most one square per file, so multiplying stacks them up in the top byte
+// without any carries. Multiplying the byte again copies it to every row, the mask picks the diagonal.
+static inline uint8_t diagonal_to_byte(uint_fast64_t board, uint_fast64_t mask)
+{
+  return ((board & mask) * FILES_TO_BYTE) >> 56;
+}
+
+static inline uint_fast64_t byte_to_diagonal(uint8_t line, uint_fast64_t mask)
+{
+  return (line * FILES_TO_BYTE) & mask;
+}
+
+uint_fast64_t flips_table(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move)
+{
+  int sq = ctzll(move);
+  int x = sq % BOARD_WIDTH, y = sq / BOARD_WIDTH;
+  uint_fast64_t result;
+
+  int row = BOARD_WIDTH * y;
+  result = (uint_fast64_t)flip_line(x, mine >> row, theirs >> row) << row;
+
+  uint8_t column = flip_line(y,
+                             (((mine >> x) & FILE_A) * FILE_TO_BYTE) >> 56,
+                             (((theirs >> x) & FILE_A) * FILE_TO_BYTE) >> 56);
+  result |= byte_to_file[column] << x;
+
+  result |= byte_to_diagonal(flip_line(x, diagonal_to_byte(mine, diagonal[sq]), diagonal_to_byte(theirs, diagonal[sq])),
+                             diagonal[sq]);
+  result |= byte_to_diagonal(flip_line(x, diagonal_to_byte(mine, anti_diagonal[sq]), diagonal_to_byte(theirs, anti_diagonal[sq])),
+                             anti_diagonal[sq]);
+
+  return result;
+}
+
+#if HAVE_AVX2
+
+#define BMI2 __attribute__((target("bmi2")))
+
+// With BMI2, pext squeezes any line into a byte and pdep spreads it back out.
+// The position on the line is simply the number of line squares before ours.
+static inline BMI2 uint_fast64_t flip_line_pext(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move, uint_fast64_t mask)
+{
+  int p = popcountll(mask & (move - 1));
+  return _pdep_u64(flip_line(p, _pext_u64(mine, mask), _pext_u64(theirs, mask)), mask);
+}
+
+BMI2 uint_fast64_t flips_pext(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move)
+{
+  int sq = ctzll(move);
+
+  return flip_line_pext(mine, theirs, move, 0xFFULL << (sq & ~7)) |
+         flip_line_pext(mine, theirs, move, FILE_A << (sq & 7)) |
+         flip_line_pext(mine, theirs, move, diagonal[sq]) |
+         flip_line_pext(mine, theirs, move, anti_diagonal[sq]);
+}
+
+#endif // HAVE_AVX2
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "base.h"
+#include "symmetry.h"
+
+// PATTERN EVALUATION
+// Scores a whole position as the sum of weights for what is on a few groups of squares (patterns):
+// the edges, the corners, the rows further in and the diagonals. A pattern with n squares can look
+// 3^n ways, so every way gets its own weight, found at its base 3 code: a square counts 0 when it
+// is empty, 1 for our stones and 2 for theirs, and the first square of the pattern is the lowest digit.
+// All turned or mirrored copies of a pattern share their weights, so every pattern has to be
+// learned only once. The weights change as the game goes on, so there is a set of them for every phase.
+//
+// Learned weights come from train.c as a file, everything little endian:
+//   8 bytes   WEIGHTS_MAGIC
+//   4 bytes   PHASES
+//   4 bytes   PATTERN_WEIGHTS
+//   2 bytes   for every weight, phase by phase, as in pattern_weights
+
+#define WEIGHTS_MAGIC 0x315447574C565352 // == "RSVLWGT1"
+#define PHASES 12
+#define PATTERN_SCALE 16 // Weights are in 1/16 of the score evaluate returns
+#define DISC_SCORE 8     // Learned weights score a disc more than the other player has as 8
+#define PATTERN_INSTANCES 46
+#define PATTERN_WEIGHTS 167265 // Sum of 3^size over all patterns
+#define MAX_PATTERN_SIZE 10
+
+typedef struct Pattern
+{
+  const char *name;
+  int size;
+  uint8_t squares[MAX_PATTERN_SIZE]; // In the top left part of the board, its copies come from symmetry.h
+} Pattern;
+
+static const Pattern PATTERNS[] = {
+    {"edge_2x", 10, {0, 1, 2, 3, 4, 5, 6, 7, 9, 14}},
+    {"corner_3x3", 9, {0, 1, 2, 8, 9, 10, 16, 17, 18}},
+    {"corner_2x5", 10, {0, 1, 2, 3, 4, 8, 9, 10, 11, 12}},
+    {"row_2", 8, {8, 9, 10, 11, 12, 13, 14, 15}},
+    {"row_3", 8, {16, 17, 18, 19, 20, 21, 22, 23}},
+    {"row_4", 8, {24, 25, 26, 27, 28, 29, 30, 31}},
+    {"diagonal_8", 8, {0, 9, 18, 27, 36, 45, 54, 63}},
+    {"diagonal_7", 7, {1, 10, 19, 28, 37, 46, 55}},
+    {"diagonal_6", 6, {2, 11, 20, 29, 38, 47}},
+    {"diagonal_5", 5, {3, 12, 21, 30, 39}},
+    {"diagonal_4", 4, {4, 13, 22, 31}},
+};
+
+#define PATTERN_COUNT (int)(sizeof(PATTERNS) / sizeof(*PATTERNS))
+
+enum PatternNames
+{
+  EDGE_2X,
+  CORNER_3X3,
+  CORNER_2X5,
+  ROW_2,
+  ROW_3,
+  ROW_4,
+  DIAGONAL_8,
+  DIAGONAL_7,
+  DIAGONAL_6,
+  DIAGONAL_5,
+  DIAGONAL_4,
+};
+
+// Every copy of a pattern is the pattern itself on a board turned by some symmetry.
+// These are the symmetries that give different copies, init_patterns makes sure of that.
+typedef struct PatternInstance
+{
+  uint8_t pattern;
+  uint8_t symmetry;
+} PatternInstance;
+
+static const PatternInstance INSTANCES[PATTERN_INSTANCES] = {
+    {EDGE_2X, 0}, {EDGE_2X, 2}, {EDGE_2X, 4}, {EDGE_2X, 5},
+    {CORNER_3X3, 0}, {CORNER_3X3, 1}, {CORNER_3X3, 2}, {CORNER_3X3, 3},
+    {CORNER_2X5, 0}, {CORNER_2X5, 1}, {CORNER_2X5, 2}, {CORNER_2X5, 3},
+    {CORNER_2X5, 4}, {CORNER_2X5, 5}, {CORNER_2X5, 6}, {CORNER_2X5, 7},
+    {ROW_2, 0}, {ROW_2, 2}, {ROW_2, 4}, {ROW_2, 5},
+    {ROW_3, 0}, {ROW_3, 2}, {ROW_3, 4}, {ROW_3, 5},
+    {ROW_4, 0}, {ROW_4, 2}, {ROW_4, 4}, {ROW_4, 5},
+    {DIAGONAL_8, 0}, {DIAGONAL_8, 1},
+    {DIAGONAL_7, 0}, {DIAGONAL_7, 1}, {DIAGONAL_7, 2}, {DIAGONAL_7, 3},
+    {DIAGONAL_6, 0}, {DIAGONAL_6, 1}, {DIAGONAL_6, 2}, {DIAGONAL_6, 3},
+    {DIAGONAL_5, 0}, {DIAGONAL_5, 1}, {DIAGONAL_5, 2}, {DIAGONAL_5, 3},
+    {DIAGONAL_4, 0}, {DIAGONAL_4, 1}, {DIAGONAL_4, 2}, {DIAGONAL_4, 3},
+};
+
+uint32_t instance_offset[PATTERN_INSTANCES]; // Where the weights of a copy's pattern start
+uint32_t pattern_offset[PATTERN_COUNT];
+uint8_t instance_squares[PATTERN_INSTANCES][MAX_PATTERN_SIZE]; // The squares of every copy, in the pattern's order
+uint_fast64_t instance_mask[PATTERN_INSTANCES];                 // The same as a bitboard
+// Reads the stones on the squares of a copy, lowest square first as pext gives them, as base 3 digits
+// in the pattern's order. Copies that read their squares in the same order share a table.
+const uint16_t *instance_ternary[PATTERN_INSTANCES];
+uint16_t ternary_tables[PATTERN_INSTANCES][1 << MAX_PATTERN_SIZE];
+int16_t pattern_weights[PHASES][PATTERN_WEIGHTS];
+
+static inline int phase(Board b)
+{
+  return (popcountll(b.mine | b.theirs) - 4) * PHASES / (BOARD_WIDTH * BOARD_HEIGHT - 3);
+}
+
+// The base 3 code of every copy of every pattern on b, straight from the squares of the copy.
+// INSTANCES is constant, so after unrolling every copy is just its few loads.
+void pattern_codes_squares(Board b, uint32_t *codes)
+{
+  uint8_t digits[BOARD_WIDTH * BOARD_HEIGHT];
+
+  for (int sq = 0; sq < BOARD_WIDTH * BOARD_HEIGHT; sq++)
+    digits[sq] = (b.mine >> sq & 1) + 2 * (b.theirs >> sq & 1);
+
+#pragma GCC unroll 46
+  for (int i = 0; i < PATTERN_INSTANCES; i++)
+  {
+    uint32_t code = 0;
+#pragma GCC unroll 10
+    for (int k = PATTERNS[INSTANCES[i].pattern].size - 1; k >= 0; k--)
+      code = 3 * code + digits[instance_squares[i][k]];
+    codes[i] = code;
+  }
+}
+
+#if HAVE_AVX2
+
+// With BMI2, pext squeezes the squares of a copy together, and its table reads them as its code.
+BMI2 void pattern_codes_pext(Board b, uint32_t *codes)
+{
+#pragma GCC unroll 46
+  for (int i = 0; i < PATTERN_INSTANCES; i++)
+    codes[i] = instance_ternary[i][_pext_u64(b.mine, instance_mask[i])] +
+               2 * instance_ternary[i][_pext_u64(b.theirs, instance_mask[i])];
+}
+
+#endif // HAVE_AVX2
+
+// Set to the faster version by init_patterns.
+void (*pattern_codes_impl)(Board b, uint32_t *codes) = pattern_codes_squares;
+
+static inline void pattern_codes(Board b, uint32_t *codes)
+{
+  pattern_codes_impl(b, codes);
+}
+
+// How long a version of pattern_codes takes for a fixed set of made up positions, in ms.
+double time_pattern_codes(void (*candidate)(Board, uint32_t *))
+{
+  uint64_t state = 0x5061747465726E; // == "Pattern"
+  volatile uint32_t sink = 0;
+  uint32_t codes[PATTERN_INSTANCES];
+  double start = now_ms();
+
+  for (int i = 0; i < 4096; i++)
+  {
+    Board b;
+    b.mine = next_random(&state) & next_random(&state);
+    b.theirs = next_random(&state) & ~b.mine;
+
+    candidate(b, codes);
+    sink = sink + codes[i % PATTERN_INSTANCES];
+  }
+
+  return now_ms() - start;
+}
+
+// Builds the table of copy i, unless another copy reads its squares in the same order.
+static void init_instance_ternary(int i)
+{
+  int size = PATTERNS[INSTANCES[i].pattern].size;
+  int digit[MAX_PATTERN_SIZE]; // Which digit the n-th lowest square of the copy is
+  int n = 0;
+
+  for (uint_fast64_t q = instance_mask[i]; q; q &= q - 1, n++)
+  {
+    for (int k = 0; k < size; k++)
+    {
+      if (instance_squares[i][k] == ctzll(q))
+        digit[n] = k;
+    }
+  }
+
+  for (int j = 0; j < i; j++)
+  {
+    int k = 0;
+    if (PATTERNS[INSTANCES[j].pattern].size != size)
+      continue;
+    for (uint_fast64_t q = instance_mask[j]; q; q &= q - 1, k++)
+    {
+      if (instance_squares[j][digit[k]] != ctzll(q))
+        break;
+    }
+    if (k == size)
+    {
+      instance_ternary[i] = instance_ternary[j];
+      return;
+    }
+  }
+
+  uint16_t *table = ternary_tables[i];
+  for (int bits = 0; bits < 1 << size; bits++)
+  {
+    int code = 0, power = 1;
+    for (int k = 0; k < size; k++, power *= 3)
+    {
+      for (int m = 0; m < size; m++)
+      {
+        if (digit[m] == k && bits >> m & 1)
+          code += power;
+      }
+    }
+    table[bits] = code;
+  }
+  instance_ternary[i] = table;
+}
+
+// Until we have learned weights, every pattern gets its share of the tier values,
+// which makes the sum about the same as what tiered_value says.
+void default_weights(int *coverage)
+{
+  for (int p = 0; p < PATTERN_COUNT; p++)
+  {
+    int codes = 1;
+    for (int k = 0; k < PATTERNS[p].size; k++)
+      codes *= 3;
+
+    for (int code = 0; code < codes; code++)
+    {
+      int weight = 0;
+      for (int k = 0, c = code; k < PATTERNS[p].size; k++, c /= 3)
+      {
+        int square = PATTERNS[p].squares[k];
+        int value = tiered_value(ONE << square) * PATTERN_SCALE / coverage[square];
+        weight += c % 3 == 1 ? value : c % 3 == 2 ? -value : 0;
+      }
+
+      for (int ph = 0; ph < PHASES; ph++)
+        pattern_weights[ph][pattern_offset[p] + code] = weight;
+    }
+  }
+}
+
+// Finds all copies of the patterns and sets the default weights.
+void init_patterns(void)
+{
+  int instances = 0, offset = 0;
+  int coverage[BOARD_WIDTH * BOARD_HEIGHT] = {0};
+
+  for (int p = 0; p < PATTERN_COUNT; p++)
+  {
+    uint_fast64_t seen[SYMMETRIES];
+    int copies = 0;
+
+    pattern_offset[p] = offset;
+    for (int s = 0; s < SYMMETRIES; s++)
+    {
+      uint_fast64_t squares = 0;
+      for (int k = 0; k < PATTERNS[p].size; k++)
+        squares |= ONE << transform_square(PATTERNS[p].squares[k], s);
+
+      // Symmetric patterns like the edges are their own mirror image, we only want them once.
+      bool duplicate = false;
+      for (int c = 0; c < copies; c++)
+        duplicate |= seen[c] == squares;
+      if (duplicate)
+        continue;
+      seen[copies++] = squares;
+
+      for (uint_fast64_t q = squares; q; q &= q - 1)
+        coverage[ctzll(q)]++;
+
+      if (instances < PATTERN_INSTANCES && (INSTANCES[instances].pattern != p || INSTANCES[instances].symmetry != s))
+        instances = PATTERN_INSTANCES + 1; // Reported below
+      else if (instances < PATTERN_INSTANCES)
+      {
+        instance_offset[instances] = pattern_offset[p];
+        instance_mask[instances] = squares;
+        for (int k = 0; k < PATTERNS[p].size; k++)
+          instance_squares[instances][k] = transform_square(PATTERNS[p].squares[k], s);
+        init_instance_ternary(instances);
+      }
+      instances++;
+    }
+
+    int codes = 1;
+    for (int k = 0; k < PATTERNS[p].size; k++)
+      codes *= 3;
+    offset += codes;
+  }
+
+  if (instances != PATTERN_INSTANCES || offset != PATTERN_WEIGHTS)
+  {
+    fprintf(stderr, "The patterns don't match INSTANCES or PATTERN_WEIGHTS\n");
+    exit(EXIT_FAILURE);
+  }
+
+  default_weights(coverage);
+
+  // Like init_dispatch, we let both ways of finding the codes race each other.
+#if HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("bmi2"))
+  {
+    double squares_time = -1, pext_time = -1;
+    for (int round = 0; round < 3; round++)
+    {
+      double t = time_pattern_codes(pattern_codes_squares);
+      if (squares_time < 0 || t < squares_time)
+        squares_time = t;
+      t = time_pattern_codes(pattern_codes_pext);
+      if (pext_time < 0 || t < pext_time)
+        pext_time = t;
+    }
+    if (pext_time < squares_time)
+      pattern_codes_impl = pattern_codes_pext;
+  }
+#endif
+}
+
+// Evaluates the position for the player whose turn it is, one weight per copy of a pattern.
+int pattern_evaluate(Board b)
+{
+  uint32_t codes[PATTERN_INSTANCES];
+  const int16_t *weights = pattern_weights[phase(b)];
+  int sum = 0;
+
+  pattern_codes(b, codes);
+  for (int i = 0; i < PATTERN_INSTANCES; i++)
+    sum += weights[instance_offset[i] + codes[i]];
+
+  return sum / PATTERN_SCALE;
+}
+
+// Replaces the weights with the learned ones from path. Without usable weights, we keep the ones we have.
+bool load_weights(const char *path)
+{
+  uint64_t magic;
+  uint32_t header[2];
+  static int16_t loaded[PHASES][PATTERN_WEIGHTS];
+  FILE *f = fopen(path, "rb");
+
+  if (!f)
+  {
+    fprintf(stderr, "Could not open the weights %s\n", path);
+    return false;
+  }
+
+  bool read = fread(&magic, sizeof(magic), 1, f) == 1 && magic == WEIGHTS_MAGIC &&
+              fread(header, sizeof(header), 1, f) == 1 && header[0] == PHASES && header[1] == PATTERN_WEIGHTS &&
+              fread(loaded, sizeof(loaded), 1, f) == 1;
+  fclose(f);
+
+  if (!read)
+  {
+    fprintf(stderr, "%s are not weights for these patterns\n", path);
+    return false;
+  }
+
+  memcpy(pattern_weights, loaded, sizeof(pattern_weights));
+  return true;
+}
+
+// Writes the current weights to path, through a temporary file like book_write.
+bool save_weights(const char *path)
+{
+  char temporary[4096];
+  uint64_t magic = WEIGHTS_MAGIC;
+  uint32_t header[2] = {PHASES, PATTERN_WEIGHTS};
+
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *f = fopen(temporary, "wb");
+  if (!f)
+    return false;
+
+  bool written = fwrite(&magic, sizeof(magic), 1, f) == 1 &&
+                 fwrite(header, sizeof(header), 1, f) == 1 &&
+                 fwrite(pattern_weights, sizeof(pattern_weights), 1, f) == 1;
+  written &= !fclose(f);
+
+  return written && !rename(temporary, path);
+}
+
+#endif
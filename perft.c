@@ -0,0 +1,223 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "base.h"
+
+// PERFT
+// Counts all games up to a given number of plies from the initial position and compares
+// the result with the known counts. If the numbers match, move generation and flipping are right,
+// and the time it takes tells us how fast they are.
+// A pass counts as a ply, and a finished game counts as a leaf no matter how deep it is.
+//
+// usage: perft [-d max depth] [-j threads] [-c]
+//   -c also checks possible_moves against the slow possible_moves_curling in every position
+
+#define PERFT_DEPTH 9        // Default for -d, takes a second or so
+#define MAX_PERFT_DEPTH 11   // The deepest we know the count for
+#define SPLIT_PLIES 3        // With threads, every position this deep becomes a task of its own
+#define MAX_TASKS 64         // There are only 56 positions after 3 plies, more are counted right away
+
+static const uint64_t PERFT_COUNTS[MAX_PERFT_DEPTH + 1] = {
+    1, 4, 12, 56, 244, 1396, 8200, 55092, 390216, 3005288, 24571284, 212258800,
+};
+
+bool check_curling = false;
+
+uint64_t perft(Game *g, int depth)
+{
+  if (check_curling && g->legal_moves != possible_moves_curling(g))
+  {
+    fprintf(stderr, "possible_moves and possible_moves_curling disagree:\n");
+    print_board(g);
+    exit(EXIT_FAILURE);
+  }
+
+  if (depth == 0)
+    return 1;
+
+  if (!g->legal_moves)
+  {
+    Game passed = *g;
+    switch_stones(&passed);
+    if (!passed.legal_moves)
+      return 1; // Nobody can move, the game is over
+
+    return perft(&passed, depth - 1);
+  }
+
+  uint64_t leaves = 0;
+
+  for (uint_fast64_t possible = g->legal_moves; possible; possible &= possible - 1)
+  {
+    Game child = *g;
+    true_reverse(&child, possible & -possible);
+    switch_stones(&child);
+    leaves += perft(&child, depth - 1);
+  }
+
+  return leaves;
+}
+
+// THREADS
+// The tree is cut off SPLIT_PLIES deep, and the threads take the positions found there
+// one after the other until none are left.
+
+typedef struct Task
+{
+  Game game;
+  int depth; // Plies left to count
+  uint64_t leaves;
+} Task;
+
+typedef struct Tasks
+{
+  Task list[MAX_TASKS];
+  int count;
+  int next;          // The next task nobody took yet
+  uint64_t overflow; // Leaves of the positions that didn't fit into list
+} Tasks;
+
+// Positions that don't fit anymore are counted by the collecting thread itself.
+void add_task(Tasks *tasks, Game *g, int depth)
+{
+  if (tasks->count == MAX_TASKS)
+  {
+    tasks->overflow += perft(g, depth);
+    return;
+  }
+
+  Task t = {*g, depth, 0};
+  tasks->list[tasks->count++] = t;
+}
+
+// Collects the positions plies deep. Games that end earlier become tasks right away.
+void collect_tasks(Tasks *tasks, Game *g, int plies, int depth)
+{
+  if (plies == 0 || depth == 0)
+  {
+    add_task(tasks, g, depth);
+    return;
+  }
+
+  if (!g->legal_moves)
+  {
+    Game passed = *g;
+    switch_stones(&passed);
+    if (!passed.legal_moves)
+    {
+      add_task(tasks, g, 0);
+      return;
+    }
+
+    collect_tasks(tasks, &passed, plies - 1, depth - 1);
+    return;
+  }
+
+  for (uint_fast64_t possible = g->legal_moves; possible; possible &= possible - 1)
+  {
+    Game child = *g;
+    true_reverse(&child, possible & -possible);
+    switch_stones(&child);
+    collect_tasks(tasks, &child, plies - 1, depth - 1);
+  }
+}
+
+void *perft_worker(void *arg)
+{
+  Tasks *tasks = arg;
+  int i;
+
+  while ((i = __atomic_fetch_add(&tasks->next, 1, __ATOMIC_RELAXED)) < tasks->count)
+    tasks->list[i].leaves = perft(&tasks->list[i].game, tasks->list[i].depth);
+
+  return NULL;
+}
+
+uint64_t perft_parallel(Game *g, int depth, int threads)
+{
+  Tasks tasks;
+  pthread_t workers[threads];
+  int started = 0;
+  tasks.count = 0;
+  tasks.next = 0;
+  tasks.overflow = 0;
+  collect_tasks(&tasks, g, depth < SPLIT_PLIES ? depth : SPLIT_PLIES, depth);
+
+  // We count along, so one thread less has to be started.
+  while (started < threads - 1 && !pthread_create(&workers[started], NULL, perft_worker, &tasks))
+    started++;
+
+  perft_worker(&tasks);
+
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+
+  uint64_t leaves = tasks.overflow;
+  for (int i = 0; i < tasks.count; i++)
+    leaves += tasks.list[i].leaves;
+
+  return leaves;
+}
+
+int main(int argc, char **argv)
+{
+  int max_depth = PERFT_DEPTH;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:j:c")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd':
+      max_depth = atoi(optarg);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      check_curling = true;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d max depth] [-j threads] [-c]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (max_depth < 1 || max_depth > MAX_PERFT_DEPTH || threads < 1)
+  {
+    fprintf(stderr, "depth has to be between 1 and %d, threads at least 1\n", MAX_PERFT_DEPTH);
+    return EXIT_FAILURE;
+  }
+
+  init_zobrist();
+  init_dispatch();
+
+  Game g = init_game(BLACK);
+  bool all_right = true;
+
+  printf("depth %12s %12s %10s %10s %s\n", "leaves", "expected", "Mn/s 1", "Mn/s N", "");
+  for (int depth = 1; depth <= max_depth; depth++)
+  {
+    double start = now_ms();
+    uint64_t leaves = perft(&g, depth);
+    double single = now_ms() - start;
+
+    start = now_ms();
+    uint64_t parallel = perft_parallel(&g, depth, threads);
+    double multi = now_ms() - start;
+
+    bool right = leaves == PERFT_COUNTS[depth] && parallel == PERFT_COUNTS[depth];
+    all_right &= right;
+
+    printf("%5d %12" PRIu64 " %12" PRIu64 " %10.2f %10.2f %s\n",
+           depth, leaves, PERFT_COUNTS[depth],
+           leaves / single / 1000, parallel / multi / 1000,
+           right ? "ok" : "WRONG");
+    fflush(stdout);
+  }
+
+  printf("%d threads, %s\n", threads, all_right ? "all counts right" : "counts are off");
+
+  return all_right ? EXIT_SUCCESS : EXIT_FAILURE;
+}
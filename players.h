@@ -0,0 +1,36 @@
+#ifndef PLAYERS_H
+#define PLAYERS_H
+
+// BOTH PLAYERS IN ONE PROGRAM
+// Each player is built on its own, so both use the same names for their strategy.
+// Tools that want to run both of them include this file instead: every name the two
+// players share gets the player's name as a prefix, e.g. heuristic_player_evaluate.
+// Whatever only one of them has (like update_heuristic) keeps its name.
+
+#define evaluate heuristic_player_evaluate
+#define most_promising_move heuristic_player_most_promising_move
+#define this_players_turn heuristic_player_this_players_turn
+#define play heuristic_player_play
+#define main heuristic_player_main
+#include "heuristic_player.c"
+#undef evaluate
+#undef most_promising_move
+#undef this_players_turn
+#undef play
+#undef main
+
+#define heuristic adaptive_player_heuristic
+#define evaluate adaptive_player_evaluate
+#define most_promising_move adaptive_player_most_promising_move
+#define this_players_turn adaptive_player_this_players_turn
+#define play adaptive_player_play
+#define main adaptive_player_main
+#include "adaptive_player.c"
+#undef heuristic
+#undef evaluate
+#undef most_promising_move
+#undef this_players_turn
+#undef play
+#undef main
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef PONDER_H
+#define PONDER_H
+
+#include <pthread.h>
+
+#include "search.h"
+#include "book.h"
+
+// PONDERING
+// With -P, we don't sit idle while the opponent thinks. Right after our move, a thread guesses
+// the opponent's reply with a short search of their position, and then searches our position
+// after that reply, with no deadline, until the reply actually comes in.
+// If the opponent played what we guessed and we pondered at least as long as we would have
+// searched anyway, we answer at once with the pondered move. Otherwise we search as usual,
+// and the transposition table still holds everything the ponder search found out,
+// so the depths it reached cost next to nothing the second time.
+// The player must not change the game or anything evaluate looks at while the thread runs.
+
+#define PONDER_GUESS_DEPTH 6 // How deep we look for the opponent's likely reply
+
+typedef struct Ponder
+{
+  pthread_t thread;
+  bool running;
+  bool abort;     // Set once the reply came in
+  bool guessed;   // We know which reply we are pondering
+  bool finished;  // The search got to its maximum depth before it was stopped
+  Game game;      // Our position after the guessed reply
+  Book *book;
+  SearchContext ctx;
+  SearchResult result;
+  double started; // When we started searching our position
+  double pondered; // How long we searched it
+} Ponder;
+
+void *ponder_search(void *arg)
+{
+  Ponder *p = arg;
+  Game *g = &p->game;
+
+  // Guess what the opponent does.
+  switch_stones(g);
+  if (g->legal_moves)
+  {
+    SearchResult guess = search_best_move(g, PONDER_GUESS_DEPTH, &p->ctx);
+    if (p->ctx.stopped)
+      return NULL;
+    execute_move(g, guess.move);
+  }
+  else
+    switch_stones(g); // They have to pass
+  p->guessed = true;
+
+  // Nothing to ponder if the game is over or the book answers anyway.
+  if (!g->legal_moves || book_move(p->book, g))
+    return NULL;
+
+  int empties = popcountll(empty(g));
+  int max_depth = p->ctx.max_depth < empties ? p->ctx.max_depth : empties;
+
+  p->started = now_ms();
+  p->result = search_best_move(g, max_depth, &p->ctx);
+  p->finished = !p->ctx.stopped && p->result.depth >= max_depth;
+  return NULL;
+}
+
+// Starts pondering on g, where we just moved. ctx is copied, the table and eval_data are shared.
+void ponder_start(Ponder *p, Game *g, SearchContext *ctx, Book *book)
+{
+  p->game = *g;
+  p->book = book;
+  p->ctx = *ctx;
+  p->ctx.deadline = 0;
+  p->ctx.abort = &p->abort;
+  p->abort = p->guessed = p->finished = false;
+  p->result.move = 0;
+  p->started = p->pondered = 0;
+
+  p->running = !pthread_create(&p->thread, NULL, ponder_search, p);
+}
+
+// Stops pondering, the reply came in. Safe to call when we don't ponder.
+void ponder_stop(Ponder *p)
+{
+  if (!p->running)
+    return;
+
+  __atomic_store_n(&p->abort, true, __ATOMIC_RELAXED);
+  pthread_join(p->thread, NULL);
+  p->running = false;
+  if (p->started)
+    p->pondered = now_ms() - p->started;
+}
+
+// The pondered move for g, which the opponent just moved to, or 0 if we still have to search.
+uint_fast64_t ponder_move(Ponder *p, Game *g, TimeControl *tc)
+{
+  if (!p->guessed || !p->result.move || p->game.hash != g->hash ||
+      p->game.board[BLACK] != g->board[BLACK] || p->game.board[WHITE] != g->board[WHITE] ||
+      p->game.current_player != g->current_player)
+    return 0;
+
+  if (!p->finished && p->pondered < move_budget(tc, popcountll(empty(g))))
+    return 0;
+
+  return p->result.move & g->legal_moves;
+}
+
+#endif
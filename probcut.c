@@ -0,0 +1,274 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "players.h"
+
+// PROBCUT CALIBRATION
+// Finds the numbers for probcut.h. We play games from the start, mostly with the move that evaluates best
+// and sometimes at random, and stop each at a random number of empty squares.
+// Every such position is searched without pruning to every depth up to the maximum, and for every
+// depth and probe of probcut.h we fit a line through the pairs of shallow and deep scores by least squares.
+// Scores of finished games are left out, they don't follow any line.
+// Every evaluation needs its own numbers, -e says which one we fit:
+//   patterns  the heuristic player, and the adaptive player with -w
+//   bins      the adaptive player's bins. Every position gets the measure the player would have there,
+//             from the moves that led to it, seen by the player to move.
+// The table goes to stdout, ready to replace the one of that evaluation.
+//
+// usage: probcut [-e patterns|bins] [-n positions] [-S seed] [-j threads] [-H hash MB]
+
+#define CALIBRATION_POSITIONS 3000 // Default for -n
+#define RANDOM_MOVES 4             // One move in this many is random
+#define CALIBRATION_MIN_EMPTIES 6
+#define CALIBRATION_MAX_EMPTIES 58
+
+typedef struct Calibration
+{
+  Evaluation evaluation;
+  Game *positions;
+  Measure *measures; // NULL unless we fit the bins
+  int (*scores)[MPC_MAX_DEPTH + 1]; // By position and depth
+  int count;
+  int next; // The next position nobody searches yet
+  pthread_mutex_t lock;
+  long hash_mb; // For the table of every thread
+} Calibration;
+
+// A game played up to empties empty squares. Returns false if it ended before.
+// If measure isn't NULL, it gets what the adaptive player would have measured at the end.
+bool calibration_position(Game *g, Measure *measure, int empties, unsigned *seed)
+{
+  uint_fast64_t moves[BOARD_WIDTH * BOARD_HEIGHT];
+  Players movers[BOARD_WIDTH * BOARD_HEIGHT];
+  int count = 0;
+
+  *g = init_game(BLACK);
+
+  while (popcountll(empty(g)) > empties)
+  {
+    if (!g->legal_moves)
+    {
+      switch_stones(g);
+      if (!g->legal_moves)
+        return false;
+    }
+
+    uint_fast64_t move = g->legal_moves & -g->legal_moves;
+    if (rand_r(seed) % RANDOM_MOVES == 0)
+    {
+      int n = rand_r(seed) % popcountll(g->legal_moves);
+      move = g->legal_moves;
+      while (n--)
+        move &= move - 1;
+      move &= -move;
+    }
+    else
+    {
+      // Their worst position is our best.
+      Board b = board_of(g);
+      int best = SCORE_INF;
+      for (uint_fast64_t possible = g->legal_moves; possible; possible &= possible - 1)
+      {
+        int score = heuristic_player_evaluate(make_move(b, ctzll(possible)), NULL);
+        if (score < best)
+        {
+          best = score;
+          move = possible & -possible;
+        }
+      }
+    }
+
+    moves[count] = move;
+    movers[count++] = g->current_player;
+    execute_move(g, move);
+  }
+
+  if (!g->legal_moves)
+    switch_stones(g);
+
+  if (measure)
+  {
+    init_measure(measure);
+    for (int i = 0; i < count; i++)
+      update_heuristic(measure, moves[i], movers[i] != g->current_player);
+  }
+
+  return g->legal_moves;
+}
+
+void *calibrate_positions(void *arg)
+{
+  Calibration *c = arg;
+  // Every thread has a table of its own, so it can clear it whenever it wants.
+  // Without a table of probcut.h, nothing is pruned selectively.
+  TranspositionTable tt = tt_create(c->hash_mb);
+  SearchContext ctx = {.evaluation = c->evaluation, .tt = &tt, .threads = 1, .max_depth = MPC_MAX_DEPTH};
+
+  while (true)
+  {
+    pthread_mutex_lock(&c->lock);
+    int i = c->next++;
+    pthread_mutex_unlock(&c->lock);
+    if (i >= c->count)
+      break;
+
+    Game *g = &c->positions[i];
+    Board b = board_of(g);
+    ctx.eval_data = c->measures ? &c->measures[i] : NULL;
+    // The score of a position depends on its measure, which the table doesn't know about.
+    if (c->measures)
+      tt_clear(&tt);
+    for (int depth = 0; depth <= MPC_MAX_DEPTH; depth++)
+      c->scores[i][depth] = negamax(b, g->current_player, g->hash, depth, -SCORE_INF, SCORE_INF, &ctx);
+
+    if (i % 100 == 0)
+      fprintf(stderr, "%d of %d positions\n", i, c->count);
+  }
+
+  tt_free(&tt);
+  return NULL;
+}
+
+// Least squares through all positions of phase, deep against shallow.
+ProbCut fit(Calibration *c, int phase, int depth, int shallow)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int n = 0;
+
+  for (int i = 0; i < c->count; i++)
+  {
+    int x = c->scores[i][shallow], y = c->scores[i][depth];
+    if (mpc_phase(board_of(&c->positions[i])) != phase || abs(x) >= SCORE_WIN / 2 || abs(y) >= SCORE_WIN / 2)
+      continue;
+    sx += x;
+    sy += y;
+    sxx += (double)x * x;
+    sxy += (double)x * y;
+    n++;
+  }
+
+  ProbCut p = {0, 0, 0};
+  double variance = sxx - sx * sx / n;
+  if (n < MPC_MIN_SAMPLES || variance <= 0)
+    return p;
+
+  p.a = (sxy - sx * sy / n) / variance;
+  p.b = (sy - p.a * sx) / n;
+
+  double squared = 0;
+  for (int i = 0; i < c->count; i++)
+  {
+    int x = c->scores[i][shallow], y = c->scores[i][depth];
+    if (mpc_phase(board_of(&c->positions[i])) != phase || abs(x) >= SCORE_WIN / 2 || abs(y) >= SCORE_WIN / 2)
+      continue;
+    double error = y - (p.a * x + p.b);
+    squared += error * error;
+  }
+  p.sigma = sqrt(squared / n);
+
+  return p;
+}
+
+void probcut_usage(char *name)
+{
+  fprintf(stderr, "usage: %s [-e patterns|bins] [-n positions] [-S seed] [-j threads] [-H hash MB]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  Calibration c = {.evaluation = heuristic_player_evaluate, .count = CALIBRATION_POSITIONS,
+                   .lock = PTHREAD_MUTEX_INITIALIZER, .hash_mb = TT_SIZE};
+  const char *table = "pattern_probcut";
+  unsigned seed = 1;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+
+  while ((opt = getopt(argc, argv, "e:n:S:j:H:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'e':
+      if (!strcmp(optarg, "bins"))
+      {
+        c.evaluation = adaptive_player_evaluate;
+        table = "bins_probcut";
+      }
+      else if (strcmp(optarg, "patterns"))
+        probcut_usage(argv[0]);
+      break;
+    case 'n':
+      c.count = atoi(optarg);
+      break;
+    case 'S':
+      seed = strtoul(optarg, NULL, 10);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'H':
+      c.hash_mb = atol(optarg);
+      break;
+    default:
+      probcut_usage(argv[0]);
+    }
+  }
+
+  if (c.count < 1 || threads < 1 || threads > MAX_THREADS || c.hash_mb < 1 || c.hash_mb > TT_MAX_SIZE)
+    probcut_usage(argv[0]);
+
+  init_zobrist();
+  init_dispatch();
+  init_patterns();
+  init_features();
+
+  c.positions = malloc(c.count * sizeof(*c.positions));
+  c.scores = malloc(c.count * sizeof(*c.scores));
+  if (c.evaluation == adaptive_player_evaluate)
+    c.measures = malloc(c.count * sizeof(*c.measures));
+  if (!c.positions || !c.scores || (c.evaluation == adaptive_player_evaluate && !c.measures))
+  {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < c.count;)
+  {
+    int empties = CALIBRATION_MIN_EMPTIES + rand_r(&seed) % (CALIBRATION_MAX_EMPTIES - CALIBRATION_MIN_EMPTIES + 1);
+    if (calibration_position(&c.positions[i], c.measures ? &c.measures[i] : NULL, empties, &seed))
+      i++;
+  }
+
+  pthread_t workers[MAX_THREADS];
+  int started = 0;
+  while (started < threads - 1 && !pthread_create(&workers[started], NULL, calibrate_positions, &c))
+    started++;
+  calibrate_positions(&c);
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+
+  printf("static const ProbCut %s[MPC_PHASES][MPC_MAX_DEPTH + 1][MPC_PROBES] = {\n", table);
+  for (int phase = 0; phase < MPC_PHASES; phase++)
+  {
+    printf("    {\n");
+    for (int depth = 0; depth <= MPC_MAX_DEPTH; depth++)
+    {
+      printf("        {");
+      for (int probe = 0; probe < MPC_PROBES; probe++)
+      {
+        ProbCut p = {0, 0, 0};
+        if (depth >= MPC_MIN_DEPTH)
+          p = fit(&c, phase, depth, mpc_probe_depth(depth, probe));
+        printf("{%.3f, %.2f, %.2f}%s", p.a, p.b, p.sigma, probe + 1 < MPC_PROBES ? ", " : "");
+      }
+      printf("}, // depth %d\n", depth);
+    }
+    printf("    },\n");
+  }
+  printf("};\n");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,230 @@
+#ifndef PROBCUT_H
+#define PROBCUT_H
+
+#include "base.h"
+
+// MULTI-PROBCUT
+// A deep search and a shallow search of the same position mostly agree: the deep score is about
+// a * shallow + b, give or take sigma. So before we search a position deeply, we ask a shallow
+// search whether the deep one would almost surely end up above beta or below alpha, and if so,
+// we believe it and skip the deep search. Most of the tree is cut off like this, which buys us a
+// few plies more in the same time, at the risk of missing a move now and then.
+// "Multi" since every depth gets two probes, a cheap one first, and the numbers differ by phase.
+//
+// The numbers come from probcut.c, which searches a corpus of positions at every depth without
+// pruning and fits the lines. They only hold for the evaluation they were fit to, so every evaluation
+// has its own table, which the player hands to the search in SearchContext.probcut:
+// pattern_probcut for patterns and features (the heuristic player, and the adaptive player with -w),
+// bins_probcut for the adaptive player's bins and features. Without a table, we never cut.
+// Depths above MPC_MAX_DEPTH use the numbers of MPC_MAX_DEPTH, with the probes just as many plies shallower.
+// Only null window searches are cut, the principal variation is always searched properly.
+
+#define MPC_MIN_DEPTH 3  // Below this, probing costs more than it saves
+#define MPC_MAX_DEPTH 10 // Deepest depth with its own numbers
+#define MPC_PROBES 2
+#define MPC_PHASES 6     // By empty squares: 1-10, 11-20, ..., 51-60
+#define MPC_CERTAINTY 1.5 // How many sigmas we want to be away from the window before we cut
+#define MPC_MIN_SAMPLES 32 // probcut.c leaves out fits from fewer samples than this
+
+typedef struct ProbCut
+{
+  float a, b;  // deep = a * shallow + b
+  float sigma; // 0 if there aren't any numbers, then we never cut
+} ProbCut;
+
+static inline int mpc_phase(Board b)
+{
+  int empties = popcountll(~(b.mine | b.theirs));
+  return empties ? (empties - 1) / 10 : 0;
+}
+
+// Rounding without libm, the players are built without it.
+static inline int round_up(float x)
+{
+  int i = (int)x;
+  return i < x ? i + 1 : i;
+}
+
+static inline int round_down(float x)
+{
+  int i = (int)x;
+  return i > x ? i - 1 : i;
+}
+
+// How deep probe i of a search to depth goes, for depths up to MPC_MAX_DEPTH.
+static inline int mpc_probe_depth(int depth, int probe)
+{
+  return probe ? depth / 2 : depth / 4;
+}
+
+// The probes of a search to depth (at most MPC_MAX_DEPTH) on b in table, which is one of the ones below.
+static inline const ProbCut *mpc_cuts(const ProbCut *table, Board b, int depth)
+{
+  return table + (mpc_phase(b) * (MPC_MAX_DEPTH + 1) + depth) * MPC_PROBES;
+}
+
+// [phase][depth][probe], written by probcut.c -e patterns from 3000 positions.
+static const ProbCut pattern_probcut[MPC_PHASES][MPC_MAX_DEPTH + 1][MPC_PROBES] = {
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.067, 32.59, 53.95}, {1.049, 5.73, 39.16}}, // depth 3
+        {{1.076, -17.13, 56.17}, {1.052, 4.43, 40.03}}, // depth 4
+        {{1.099, 13.03, 70.38}, {1.076, 35.17, 58.58}}, // depth 5
+        {{1.123, -10.36, 98.19}, {1.079, -16.29, 78.90}}, // depth 6
+        {{1.134, 29.82, 96.47}, {1.094, 22.22, 76.67}}, // depth 7
+        {{1.153, 23.73, 113.90}, {1.119, 19.78, 88.73}}, // depth 8
+        {{1.193, 41.91, 120.83}, {1.164, 40.17, 96.11}}, // depth 9
+        {{1.230, 26.89, 156.76}, {1.179, -18.96, 117.11}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.081, 22.99, 54.15}, {1.059, 3.80, 37.22}}, // depth 3
+        {{1.092, -10.47, 49.39}, {1.062, 4.01, 35.41}}, // depth 4
+        {{1.119, 8.01, 58.21}, {1.090, 22.87, 45.64}}, // depth 5
+        {{1.146, -9.18, 71.06}, {1.090, -13.86, 45.37}}, // depth 6
+        {{1.177, 11.25, 78.26}, {1.123, 6.58, 52.18}}, // depth 7
+        {{1.166, 6.92, 77.45}, {1.118, 3.64, 53.93}}, // depth 8
+        {{1.203, 32.82, 87.80}, {1.155, 29.11, 65.19}}, // depth 9
+        {{1.229, 13.55, 102.90}, {1.156, -13.25, 69.67}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.119, 24.38, 54.55}, {1.074, 1.95, 35.71}}, // depth 3
+        {{1.111, -11.93, 46.97}, {1.073, 2.51, 31.03}}, // depth 4
+        {{1.146, 3.51, 55.96}, {1.108, 18.60, 42.06}}, // depth 5
+        {{1.183, -10.71, 65.05}, {1.108, -13.05, 36.05}}, // depth 6
+        {{1.223, 5.64, 72.92}, {1.147, 3.39, 43.88}}, // depth 7
+        {{1.226, 5.71, 66.85}, {1.150, 3.27, 43.86}}, // depth 8
+        {{1.265, 23.07, 74.25}, {1.186, 20.49, 51.84}}, // depth 9
+        {{1.301, 6.63, 81.43}, {1.184, -15.68, 48.78}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.225, 24.27, 54.03}, {1.139, -1.85, 35.69}}, // depth 3
+        {{1.211, -19.50, 47.29}, {1.128, 1.30, 31.26}}, // depth 4
+        {{1.268, -1.77, 54.90}, {1.181, 20.01, 40.32}}, // depth 5
+        {{1.336, -19.78, 63.92}, {1.184, -17.99, 36.43}}, // depth 6
+        {{1.387, -1.31, 70.37}, {1.231, 0.47, 41.74}}, // depth 7
+        {{1.355, 5.98, 62.28}, {1.211, 4.21, 37.57}}, // depth 8
+        {{1.397, 24.55, 67.65}, {1.250, 22.95, 44.05}}, // depth 9
+        {{1.463, 6.64, 74.03}, {1.250, -18.43, 41.32}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.042, 21.33, 35.44}, {1.087, 2.21, 20.07}}, // depth 3
+        {{1.120, -10.87, 26.60}, {1.108, 1.44, 19.59}}, // depth 4
+        {{1.184, 4.10, 31.75}, {1.163, 17.14, 26.38}}, // depth 5
+        {{1.232, -10.73, 37.06}, {1.188, -14.21, 21.28}}, // depth 6
+        {{1.297, 5.15, 41.52}, {1.262, 1.27, 24.67}}, // depth 7
+        {{1.347, 3.68, 38.71}, {1.263, 1.64, 22.10}}, // depth 8
+        {{1.389, 22.02, 43.08}, {1.309, 19.87, 26.74}}, // depth 9
+        {{1.462, 4.86, 47.29}, {1.308, -17.80, 23.72}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{0.384, 3.85, 13.32}, {0.826, 1.64, 7.07}}, // depth 3
+        {{0.730, -0.98, 8.23}, {0.858, -0.42, 5.08}}, // depth 4
+        {{0.747, 1.96, 7.88}, {0.832, 2.60, 6.23}}, // depth 5
+        {{0.660, -1.25, 8.60}, {0.810, -2.60, 6.16}}, // depth 6
+        {{0.685, 2.48, 8.28}, {0.855, 1.02, 4.88}}, // depth 7
+        {{0.733, -0.81, 6.74}, {0.867, -0.47, 4.65}}, // depth 8
+        {{0.712, 3.97, 8.26}, {0.823, 4.32, 7.26}}, // depth 9
+        {{0.700, -1.42, 7.47}, {0.778, -3.37, 7.11}}, // depth 10
+    },
+};
+
+// The same for the adaptive player's bins, written by probcut.c -e bins from 3000 positions.
+static const ProbCut bins_probcut[MPC_PHASES][MPC_MAX_DEPTH + 1][MPC_PROBES] = {
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.063, 42.78, 61.96}, {1.045, 3.12, 45.81}}, // depth 3
+        {{1.069, -29.38, 67.61}, {1.049, 3.99, 48.16}}, // depth 4
+        {{1.093, 9.24, 79.45}, {1.074, 43.61, 65.74}}, // depth 5
+        {{1.111, -18.76, 113.41}, {1.074, -22.04, 89.98}}, // depth 6
+        {{1.124, 27.07, 114.27}, {1.092, 21.54, 88.59}}, // depth 7
+        {{1.145, 29.31, 131.42}, {1.116, 25.73, 99.93}}, // depth 8
+        {{1.188, 47.09, 141.77}, {1.164, 45.46, 112.25}}, // depth 9
+        {{1.211, 32.82, 182.16}, {1.168, -29.18, 135.94}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.088, 32.56, 57.50}, {1.064, 1.36, 40.45}}, // depth 3
+        {{1.098, -22.98, 56.70}, {1.066, 5.80, 40.59}}, // depth 4
+        {{1.127, 5.47, 65.80}, {1.095, 35.04, 52.38}}, // depth 5
+        {{1.156, -20.80, 82.85}, {1.095, -23.05, 54.21}}, // depth 6
+        {{1.189, 8.59, 92.71}, {1.129, 6.10, 62.85}}, // depth 7
+        {{1.172, 11.58, 91.28}, {1.121, 6.89, 62.59}}, // depth 8
+        {{1.211, 45.68, 103.43}, {1.160, 40.56, 76.48}}, // depth 9
+        {{1.234, 20.79, 121.41}, {1.157, -21.33, 84.51}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.126, 35.47, 58.13}, {1.080, -0.71, 36.65}}, // depth 3
+        {{1.120, -26.14, 50.07}, {1.077, 1.82, 33.89}}, // depth 4
+        {{1.157, -0.60, 59.35}, {1.114, 28.58, 46.01}}, // depth 5
+        {{1.198, -26.65, 69.08}, {1.116, -26.20, 39.50}}, // depth 6
+        {{1.240, -0.54, 76.81}, {1.157, 0.06, 46.80}}, // depth 7
+        {{1.241, 3.36, 71.95}, {1.160, 1.80, 46.27}}, // depth 8
+        {{1.286, 31.05, 81.08}, {1.202, 29.45, 56.59}}, // depth 9
+        {{1.323, 4.68, 89.02}, {1.198, -30.33, 53.70}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{1.209, 35.54, 60.14}, {1.141, -6.18, 36.04}}, // depth 3
+        {{1.212, -36.54, 47.66}, {1.128, 0.14, 32.74}}, // depth 4
+        {{1.270, -10.23, 53.50}, {1.180, 28.25, 41.11}}, // depth 5
+        {{1.336, -39.79, 63.18}, {1.179, -33.10, 36.01}}, // depth 6
+        {{1.392, -12.88, 70.33}, {1.231, -6.05, 41.99}}, // depth 7
+        {{1.361, 1.36, 64.55}, {1.214, 0.91, 40.18}}, // depth 8
+        {{1.404, 30.45, 70.24}, {1.254, 30.09, 47.29}}, // depth 9
+        {{1.473, 0.98, 77.70}, {1.256, -34.89, 46.53}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{0.963, 35.14, 39.11}, {1.080, 1.42, 21.71}}, // depth 3
+        {{1.127, -26.30, 29.05}, {1.128, 2.02, 21.77}}, // depth 4
+        {{1.209, 0.67, 33.23}, {1.199, 31.09, 27.64}}, // depth 5
+        {{1.249, -28.47, 38.08}, {1.201, -31.42, 21.46}}, // depth 6
+        {{1.330, 0.18, 42.33}, {1.285, -3.15, 24.76}}, // depth 7
+        {{1.385, 4.63, 39.95}, {1.264, 1.99, 22.24}}, // depth 8
+        {{1.445, 36.32, 42.83}, {1.317, 33.58, 25.66}}, // depth 9
+        {{1.517, 6.06, 46.77}, {1.301, -34.46, 22.67}}, // depth 10
+    },
+    {
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 0
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 1
+        {{0.000, 0.00, 0.00}, {0.000, 0.00, 0.00}}, // depth 2
+        {{0.401, 18.52, 11.84}, {0.509, 9.53, 9.23}}, // depth 3
+        {{0.366, -11.75, 9.86}, {0.467, -5.73, 9.29}}, // depth 4
+        {{0.452, 8.86, 8.53}, {0.440, 15.89, 9.97}}, // depth 5
+        {{0.301, -12.34, 9.21}, {0.596, -18.05, 7.35}}, // depth 6
+        {{0.332, 11.87, 7.66}, {0.599, 6.51, 5.96}}, // depth 7
+        {{0.365, -9.50, 7.24}, {0.642, -6.02, 5.51}}, // depth 8
+        {{0.322, 17.41, 7.69}, {0.612, 20.81, 5.81}}, // depth 9
+        {{0.305, -10.72, 7.61}, {0.601, -20.39, 5.41}}, // depth 10
+    },
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "base.h"
+
+// PROTOCOL
+// The referee talks to us in lines, which end in LF or CR LF:
+//   init: X      we play X (or O), a new game starts
+//   srand: <n>   seed for the random numbers
+//   <column><row> the opponent set there, e.g. d3, and it's our turn
+//   none         the opponent had to pass, and it's our turn
+//   exit         we are done
+// We answer each turn with our move or none on a line of its own.
+//
+// Input is read in large chunks into one buffer, which we cut into lines right where they are,
+// so reading a command never allocates anything. What we write is collected and goes out
+// in one go right before we have to wait for more input.
+// Lines we don't understand, and moves that aren't legal, are skipped with a complaint on stderr.
+// The game goes on either way.
+
+#define PROTOCOL_BUFFER 4096 // Longer lines are malformed anyway
+
+typedef enum CommandType
+{
+  COMMAND_EXIT,
+  COMMAND_INIT,
+  COMMAND_SRAND,
+  COMMAND_NONE,
+  COMMAND_MOVE,
+  COMMAND_MALFORMED
+} CommandType;
+
+typedef struct Command
+{
+  CommandType type;
+  Players stone;   // COMMAND_INIT
+  unsigned seed;   // COMMAND_SRAND
+  Position pos;    // COMMAND_MOVE
+  const char *line; // Without the line break, valid until the next command is read
+} Command;
+
+typedef struct Protocol
+{
+  _Alignas(64) char in[PROTOCOL_BUFFER];
+  _Alignas(64) char out[PROTOCOL_BUFFER];
+  size_t start, end; // What we read but didn't look at yet is in[start, end)
+  size_t written;    // What is waiting in out
+  bool too_long;     // We are skipping the rest of a line that didn't fit
+  int in_fd;
+  int out_fd;
+} Protocol;
+
+void protocol_init(Protocol *p, int in_fd, int out_fd)
+{
+  p->start = p->end = p->written = 0;
+  p->too_long = false;
+  p->in_fd = in_fd;
+  p->out_fd = out_fd;
+}
+
+// Sends everything we wrote so far.
+void protocol_flush(Protocol *p)
+{
+  size_t sent = 0;
+
+  while (sent < p->written)
+  {
+    ssize_t n = write(p->out_fd, p->out + sent, p->written - sent);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // Nobody is listening anymore, the next read will tell
+    sent += n;
+  }
+
+  p->written = 0;
+}
+
+void protocol_write(Protocol *p, const char *s, size_t length)
+{
+  if (p->written + length > PROTOCOL_BUFFER)
+    protocol_flush(p);
+
+  memcpy(p->out + p->written, s, length);
+  p->written += length;
+}
+
+// Our move as the referee wants it, or none if we have to pass.
+void protocol_write_move(Protocol *p, Position pos)
+{
+  if (pos.x < 0)
+  {
+    protocol_write(p, "none\n", 5);
+    return;
+  }
+
+  char move[3] = {'a' + pos.x, '1' + pos.y, '\n'};
+  protocol_write(p, move, sizeof(move));
+}
+
+// The next line without its line break, or NULL once the input ended.
+// A last line without a line break still counts.
+char *protocol_read_line(Protocol *p)
+{
+  while (true)
+  {
+    char *line = p->in + p->start;
+    char *newline = memchr(line, '\n', p->end - p->start);
+
+    if (newline)
+    {
+      p->start = newline - p->in + 1;
+      *newline = '\0';
+      if (newline > line && newline[-1] == '\r')
+        newline[-1] = '\0';
+      if (!p->too_long)
+        return line;
+
+      // The end of a line that didn't fit.
+      p->too_long = false;
+      fprintf(stderr, "Skipped a line longer than %d bytes\n", PROTOCOL_BUFFER - 2);
+      continue;
+    }
+
+    // Keep the beginning of the line and make room for the rest.
+    memmove(p->in, line, p->end - p->start);
+    p->end -= p->start;
+    p->start = 0;
+    if (p->end == PROTOCOL_BUFFER - 1)
+    {
+      p->too_long = true;
+      p->end = 0;
+    }
+
+    // We are about to wait for the referee, so the referee shouldn't wait for us.
+    protocol_flush(p);
+
+    ssize_t n = read(p->in_fd, p->in + p->end, PROTOCOL_BUFFER - 1 - p->end);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      if (p->end == 0 || p->too_long)
+        return NULL;
+
+      p->in[p->end] = '\0';
+      p->start = p->end = 0;
+      return p->in;
+    }
+    p->end += n;
+  }
+}
+
+static inline char *trim(char *s)
+{
+  while (isspace((unsigned char)*s))
+    s++;
+
+  char *end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1]))
+    *--end = '\0';
+
+  return s;
+}
+
+// What line says, if it says anything we know.
+Command parse_command(char *line)
+{
+  Command c = {COMMAND_MALFORMED, BLACK, 0, {-1, -1}, line};
+  char *s = trim(line);
+
+  if (!strcmp(s, "exit"))
+    c.type = COMMAND_EXIT;
+  else if (!strcmp(s, "none"))
+    c.type = COMMAND_NONE;
+  else if (!strncmp(s, "init:", 5))
+  {
+    s = trim(s + 5);
+    if ((s[0] == 'X' || s[0] == 'O') && !s[1])
+    {
+      c.type = COMMAND_INIT;
+      c.stone = which_stone(s[0]);
+    }
+  }
+  else if (!strncmp(s, "srand:", 6))
+  {
+    char *end;
+    s = trim(s + 6);
+    c.seed = strtoul(s, &end, 10);
+    if (end != s && !*end)
+      c.type = COMMAND_SRAND;
+  }
+  else if (strlen(s) == 2)
+  {
+    int x = tolower((unsigned char)s[0]) - 'a', y = s[1] - '1';
+    if (x >= 0 && x < BOARD_WIDTH && y >= 0 && y < BOARD_HEIGHT)
+    {
+      c.type = COMMAND_MOVE;
+      c.pos = make_position(x, y);
+    }
+  }
+
+  return c;
+}
+
+// Reads the next command. Returns false once the input ended.
+bool protocol_next_command(Protocol *p, Command *c)
+{
+  char *line = protocol_read_line(p);
+  if (!line)
+    return false;
+
+  *c = parse_command(line);
+  return true;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "base.h"
+#include "timer.h"
+#include "tt.h"
+#include "endgame.h"
+#include "ordering.h"
+#include "probcut.h"
+
+// NEGAMAX SEARCH
+// Principal variation search with alpha-beta pruning. Every score is seen from
+// the player whose turn it is, so a child's score just needs to be negated.
+
+#define ASPIRATION_WINDOW 8
+#define MAX_SEARCH_DEPTH 60 // There are never more empty squares than that
+#define ENDGAME_PRESEARCH 6 // Depth we want to have for sure before we try to solve the endgame
+
+int negamax(Board b, Players side, uint64_t hash, int depth, int alpha, int beta, SearchContext *ctx);
+
+// Asks shallow searches whether a search to depth would fail high or low, see probcut.h.
+// Returns true with the bound in score if it would almost surely do so.
+bool probcut(Board b, Players side, uint64_t hash, int depth, int alpha, int beta, SearchContext *ctx, int *score)
+{
+  int row = depth > MPC_MAX_DEPTH ? MPC_MAX_DEPTH : depth;
+  const ProbCut *cuts = mpc_cuts(ctx->probcut, b, row);
+
+  for (int i = 0; i < MPC_PROBES; i++)
+  {
+    const ProbCut *p = &cuts[i];
+    if (p->sigma <= 0 || p->a <= 0)
+      continue;
+
+    int shallow = mpc_probe_depth(row, i) + depth - row;
+    float margin = MPC_CERTAINTY * p->sigma;
+
+    // The shallow score at which the deep one would be at least beta, with margin to spare.
+    int bound = round_up((beta + margin - p->b) / p->a);
+    if (bound < SCORE_WIN / 2 && negamax(b, side, hash, shallow, bound - 1, bound, ctx) >= bound)
+    {
+      *score = beta;
+      return true;
+    }
+
+    bound = round_down((alpha - margin - p->b) / p->a);
+    if (bound > -SCORE_WIN / 2 && negamax(b, side, hash, shallow, bound, bound + 1, ctx) <= bound)
+    {
+      *score = alpha;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// side and hash belong to the player to move in b, the transposition table needs them.
+int negamax(Board b, Players side, uint64_t hash, int depth, int alpha, int beta, SearchContext *ctx)
+{
+  ctx->nodes++;
+
+  if (time_is_up(ctx))
+    return 0;
+
+  uint_fast64_t possible = get_moves(b.mine, b.theirs);
+
+  // A finished game scores its final result even where we would evaluate,
+  // the evaluation is on a different scale and doesn't know the game is over.
+  if (!possible && !get_moves(b.theirs, b.mine))
+    return final_score(b);
+
+  if (depth <= 0)
+    return ctx->evaluation(b, ctx->eval_data);
+
+  // We have to pass.
+  if (!possible)
+    return -negamax(make_pass(b), !side, hash ^ zobrist_white_to_move, depth, -beta, -alpha, ctx);
+
+  int original_alpha = alpha;
+  uint_fast64_t hash_move = 0;
+  TTHit hit;
+
+  if (ctx->tt && tt_lookup(ctx, hash, &hit))
+  {
+    if (hit.depth >= depth)
+    {
+      if (hit.bound == BOUND_EXACT ||
+          (hit.bound == BOUND_LOWER && hit.score >= beta) ||
+          (hit.bound == BOUND_UPPER && hit.score <= alpha))
+        return hit.score;
+    }
+
+    // Whatever was best last time is the most likely candidate now.
+    if (hit.move != TT_NO_MOVE)
+      hash_move = possible & ONE << hit.move;
+  }
+
+  int cut;
+  if (ctx->probcut && beta - alpha == 1 && depth >= MPC_MIN_DEPTH && beta < SCORE_WIN / 2 &&
+      alpha > -SCORE_WIN / 2 && probcut(b, side, hash, depth, alpha, beta, ctx, &cut))
+    return cut;
+
+  OrderedMove list[MAX_MOVES];
+  int count = order_moves(list, b, possible, hash_move, side, depth, &ctx->ordering);
+  int best_score = -SCORE_INF;
+  uint_fast64_t best_move = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    uint_fast64_t move = list[i].move;
+    Board child = apply_move(b, move, list[i].flipped);
+    uint64_t child_hash = hash_after(hash, side, move, list[i].flipped);
+
+    int score;
+    if (best_score == -SCORE_INF)
+      score = -negamax(child, !side, child_hash, depth - 1, -beta, -alpha, ctx);
+    else
+    {
+      // Every move after the first one only has to prove that it is not better.
+      // If it turns out to be better after all, we search it again properly.
+      score = -negamax(child, !side, child_hash, depth - 1, -alpha - 1, -alpha, ctx);
+      if (score > alpha && score < beta)
+        score = -negamax(child, !side, child_hash, depth - 1, -beta, -alpha, ctx);
+    }
+
+    if (score > best_score)
+    {
+      best_score = score;
+      best_move = move;
+      if (score > alpha)
+        alpha = score;
+      if (alpha >= beta)
+      {
+        if (!ctx->stopped)
+          reward_move(&ctx->ordering, side, move, depth);
+        break;
+      }
+    }
+  }
+
+  if (ctx->tt && !ctx->stopped)
+  {
+    Bound bound = best_score <= original_alpha ? BOUND_UPPER : best_score >= beta ? BOUND_LOWER : BOUND_EXACT;
+    tt_store(ctx->tt, hash, best_score, ctzll(best_move), depth, bound);
+  }
+
+  return best_score;
+}
+
+// Same as negamax, but remembers which move was the best one.
+// first_move is tried first, which is usually the best move of the last iteration.
+SearchResult search_root(Board b, Players side, uint64_t hash, int depth, int alpha, int beta,
+                         uint_fast64_t first_move, SearchContext *ctx)
+{
+  SearchResult result = {0, -SCORE_INF, depth, 0};
+  OrderedMove list[MAX_MOVES];
+  int count = order_moves(list, b, get_moves(b.mine, b.theirs), first_move, side, depth, &ctx->ordering);
+
+  ctx->nodes++;
+
+  for (int i = 0; i < count; i++)
+  {
+    uint_fast64_t move = list[i].move;
+    Board child = apply_move(b, move, list[i].flipped);
+    uint64_t child_hash = hash_after(hash, side, move, list[i].flipped);
+
+    int score;
+    if (!result.move)
+      score = -negamax(child, !side, child_hash, depth - 1, -beta, -alpha, ctx);
+    else
+    {
+      score = -negamax(child, !side, child_hash, depth - 1, -alpha - 1, -alpha, ctx);
+      if (score > alpha && score < beta)
+        score = -negamax(child, !side, child_hash, depth - 1, -beta, -alpha, ctx);
+    }
+
+    if (ctx->stopped)
+      break;
+
+    if (score > result.score || !result.move)
+    {
+      result.score = score;
+      result.move = move;
+      if (score > alpha)
+        alpha = score;
+      if (alpha >= beta)
+        break;
+    }
+  }
+
+  return result;
+}
+
+// Whether the iteration to depth hands the position over to the endgame solver. With no more empty
+// squares than the presearch would look ahead, there is nothing to wait for and we solve right away.
+static inline bool solves_at(int empties, int depth, const SearchContext *ctx)
+{
+  return empties <= ctx->endgame_empties && (depth > ENDGAME_PRESEARCH || empties <= ENDGAME_PRESEARCH);
+}
+
+// Searches one ply deeper each iteration, from first_depth until max_depth is reached or time runs out.
+// result holds the move to try first and is handed back updated.
+// The score of the last iteration is a good guess for the next one,
+// so we start with a narrow window around it and only widen it if we miss.
+// An iteration that is cut off by the deadline doesn't count,
+// we always answer with the result of the last one that finished.
+SearchResult deepen(Game *g, SearchResult result, int first_depth, int max_depth, bool main_thread, SearchContext *ctx)
+{
+  Board b = board_of(g);
+  uint64_t hash = g->hash ^ ctx->key;
+  double start = now_ms();
+  int empties = popcountll(empty(g));
+
+  for (int depth = first_depth; depth <= max_depth; depth++)
+  {
+    // Close to the end, the solver is a lot faster than searching to the end with negamax.
+    // It is only tried once we have a decent move to fall back to, unless the game is about to end anyway.
+    if (solves_at(empties, depth, ctx))
+    {
+      SearchResult exact = ctx->threads > 1 ? solve_root_parallel(b, g->current_player, hash, result.move, ctx)
+                                            : solve_root(b, g->current_player, hash, result.move, ctx);
+      if (!ctx->stopped)
+        result = exact;
+      break;
+    }
+
+    int alpha = -SCORE_INF;
+    int beta = SCORE_INF;
+
+    if (depth > first_depth)
+    {
+      alpha = result.score - ASPIRATION_WINDOW;
+      beta = result.score + ASPIRATION_WINDOW;
+    }
+
+    SearchResult current = search_root(b, g->current_player, hash, depth, alpha, beta, result.move, ctx);
+
+    // Failed low or high: the real score lies outside our window.
+    if (!ctx->stopped && (current.score <= alpha || current.score >= beta))
+      current = search_root(b, g->current_player, hash, depth, -SCORE_INF, SCORE_INF, current.move, ctx);
+
+    if (ctx->stopped)
+      break;
+
+    result = current;
+
+    // Every iteration takes a lot longer than the one before.
+    // If we already used up half of our time, the next one won't finish anyway.
+    // Helpers don't need to care, they stop when the main thread does.
+    if (main_thread && ctx->deadline && now_ms() - start > (ctx->deadline - start) / 2)
+      break;
+  }
+
+  return result;
+}
+
+// LAZY SMP
+// With more than one thread, helpers search the very same root as the main thread.
+// They don't split up the work, they just fill the shared transposition table with
+// positions the main thread will run into a moment later, which then costs it nothing.
+// Every other helper starts one ply deeper, so they don't all search the same depth at the same time.
+// Once the main thread is done, the helpers are stopped and the deepest finished iteration wins.
+
+typedef struct Helper
+{
+  pthread_t thread;
+  Game game; // Its own copy, so nothing is shared but the table
+  int first_depth;
+  int max_depth;
+  SearchContext ctx;
+  SearchResult result;
+} Helper;
+
+void *helper_search(void *arg)
+{
+  Helper *h = arg;
+  h->result = deepen(&h->game, h->result, h->first_depth, h->max_depth, false, &h->ctx);
+  return NULL;
+}
+
+// Nothing searched yet, as far as telemetry.h is concerned.
+static inline void forget_search(SearchContext *ctx)
+{
+  ctx->nodes = 0;
+  ctx->tt_probes = 0;
+  ctx->tt_hits = 0;
+  ctx->depth = 0;
+  ctx->source = SOURCE_MIDGAME;
+}
+
+// Finds the best move in g with ctx->threads threads, or just one if that is 0.
+SearchResult search_best_move(Game *g, int max_depth, SearchContext *ctx)
+{
+  SearchResult result = {g->legal_moves & -g->legal_moves, 0, 0, 0};
+  int empties = popcountll(empty(g));
+
+  // Once we look as deep as there are empty squares, we see every game to its end.
+  if (max_depth > empties)
+    max_depth = empties;
+
+  forget_search(ctx);
+  ctx->stopped = false;
+  new_ordering(&ctx->ordering);
+  if (ctx->tt)
+    tt_new_search(ctx->tt);
+
+  if (!g->legal_moves)
+    return result;
+
+  // A previous search may already know a good move to start with.
+  TTHit hit;
+  if (ctx->tt && tt_probe(ctx->tt, g->hash ^ ctx->key, &hit) && hit.move != TT_NO_MOVE && (g->legal_moves & ONE << hit.move))
+    result.move = ONE << hit.move;
+
+  bool abort = false;
+  Helper helpers[MAX_THREADS - 1];
+  int count = ctx->threads > MAX_THREADS ? MAX_THREADS - 1 : ctx->threads > 1 ? ctx->threads - 1 : 0;
+
+  // The endgame solver splits the work between the threads itself.
+  if (solves_at(empties, max_depth, ctx))
+    count = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    Helper *h = &helpers[i];
+    h->game = *g;
+    h->first_depth = 1 + (i & 1);
+    h->max_depth = max_depth;
+    h->ctx = *ctx;
+    h->ctx.abort = &abort;
+    h->result = result;
+
+    // Without the thread we just search with fewer helpers.
+    if (pthread_create(&h->thread, NULL, helper_search, h))
+    {
+      count = i;
+      break;
+    }
+  }
+
+  result = deepen(g, result, 1, max_depth, true, ctx);
+
+  __atomic_store_n(&abort, true, __ATOMIC_RELAXED);
+  for (int i = 0; i < count; i++)
+  {
+    pthread_join(helpers[i].thread, NULL);
+    ctx->nodes += helpers[i].ctx.nodes;
+    ctx->tt_probes += helpers[i].ctx.tt_probes;
+    ctx->tt_hits += helpers[i].ctx.tt_hits;
+    if (helpers[i].result.depth > result.depth)
+      result = helpers[i].result;
+  }
+
+  result.nodes = ctx->nodes;
+  ctx->depth = result.depth;
+  // Only a search that finished all the way to the end of the game counts as endgame,
+  // a solve the deadline cut off leaves us with the move of the last midgame iteration.
+  if (result.depth >= empties)
+    ctx->source = SOURCE_ENDGAME;
+
+  return result;
+}
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+
+#include "protocol.h"
+#include "options.h"
+#include "book.h"
+#include "telemetry.h"
+
+// SERVER MODE
+// With -s, one process plays many games at once. Every line starts with the id of its game,
+// followed by a command like in protocol.h, e.g. "7 init: X", "7 d3" or "7 none",
+// and we answer with the same id in front, e.g. "7 c4". "<id> exit" ends a single game,
+// a line that is just "exit" ends them all.
+//
+// The games live in a fixed pool, and a fixed pool of workers (-j) searches for them, one search
+// per worker, all sharing one transposition table and one book. Commands for a game are handled
+// in the order they came in, and no two workers ever work on the same game. Every answer goes out
+// as soon as its search is done, so a quick game never waits for a slow one.
+// If the evaluation depends on what the player keeps for a game, the same position scores differently
+// in every game. Such games still share the table, but every game mixes a key of its own into its hashes.
+
+#define MAX_GAMES 1024
+#define MAX_JOBS 4096
+#define MAX_GAME_ID 32
+
+// What the players do differently.
+typedef struct ServerPlayer
+{
+  Evaluation evaluation;
+  const struct ProbCut *probcut; // The table of probcut.h for evaluation
+  bool stateful;                 // evaluation depends on the state, so games must not share their entries
+  size_t state_size;                                           // What the player keeps for every game, for evaluation
+  void (*new_game)(void *state);                               // NULL if there is nothing to do
+  void (*moved)(void *state, uint_fast64_t move, bool is_enemy); // NULL if there is nothing to do
+  Position (*turn)(Game *g, TimeControl *tc, SearchContext *ctx, Book *book);
+} ServerPlayer;
+
+typedef struct ServerGame
+{
+  char id[MAX_GAME_ID]; // Empty once the game is over, even if it still has commands to work off
+  bool used;
+  bool busy;    // A worker is on it
+  bool started; // We know our stone
+  Players us;
+  Game game;
+  TimeControl tc;
+  void *state;
+  uint64_t key; // For SearchContext, 0 unless the player is stateful
+} ServerGame;
+
+typedef struct Job
+{
+  ServerGame *game;
+  char id[MAX_GAME_ID]; // The game's id may be gone by the time we answer
+  CommandType type;
+  Players stone;
+  unsigned seed;
+  Position pos;
+  double received; // The referee's clock started ticking then
+} Job;
+
+typedef struct Server
+{
+  const ServerPlayer *player;
+  Options options;
+  TranspositionTable *tt;
+  Book *book;
+  ServerGame games[MAX_GAMES];
+  char *states;
+  uint64_t keys; // State of next_random for the keys of new games
+
+  pthread_mutex_t lock; // Guards the jobs and the used, busy and id of every game
+  pthread_cond_t changed; // A job came in, a game got free or we are closing
+  Job jobs[MAX_JOBS];     // In the order they came in
+  int job_count;
+  bool closing;
+
+  pthread_mutex_t out_lock;
+  int out_fd;
+  Telemetry telemetry;
+} Server;
+
+// Every answer is a single write, so answers from different workers never mix.
+void server_reply(Server *s, const char *id, Position pos)
+{
+  char reply[MAX_GAME_ID + 8];
+  int length = pos.x < 0 ? snprintf(reply, sizeof(reply), "%s none\n", id)
+                         : snprintf(reply, sizeof(reply), "%s %c%d\n", id, 'a' + pos.x, pos.y + 1);
+
+  pthread_mutex_lock(&s->out_lock);
+  for (int sent = 0; sent < length;)
+  {
+    ssize_t n = write(s->out_fd, reply + sent, length - sent);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+  pthread_mutex_unlock(&s->out_lock);
+}
+
+void run_job(Server *s, Job *job, SearchContext *ctx)
+{
+  ServerGame *sg = job->game;
+  Game *g = &sg->game;
+  const ServerPlayer *player = s->player;
+
+  switch (job->type)
+  {
+  case COMMAND_INIT:
+    sg->us = job->stone;
+    sg->game = init_game(job->stone);
+    sg->tc = s->options.tc;
+    sg->started = true;
+    if (player->new_game)
+      player->new_game(sg->state);
+    telemetry_flush(&s->telemetry);
+    return;
+
+  case COMMAND_SRAND:
+    srand(job->seed);
+    return;
+
+  case COMMAND_MOVE:
+  case COMMAND_NONE:
+    break;
+
+  default:
+    return;
+  }
+
+  if (!sg->started)
+  {
+    fprintf(stderr, "Game %s didn't start yet\n", job->id);
+    return;
+  }
+
+  if (job->type == COMMAND_MOVE)
+  {
+    switch_stones(g); // switch to opponent
+    if (!legal(g, job->pos.x, job->pos.y))
+    {
+      switch_stones(g);
+      fprintf(stderr, "Illegal move in game %s: %c%d\n", job->id, 'a' + job->pos.x, job->pos.y + 1);
+      return;
+    }
+    reverse(g, job->pos.x, job->pos.y); // make opponent move
+    if (player->moved)
+      player->moved(sg->state, field_at(job->pos.x, job->pos.y), true);
+    switch_stones(g); // switch back to this player
+  }
+
+  ctx->eval_data = sg->state;
+  ctx->key = sg->key;
+  Position pos = player->turn(g, &sg->tc, ctx, s->book);
+  if (pos.x >= 0)
+  {
+    reverse(g, pos.x, pos.y);
+    if (player->moved)
+      player->moved(sg->state, field_at(pos.x, pos.y), false);
+  }
+
+  server_reply(s, job->id, pos);
+  double spent = now_ms() - job->received;
+  sg->tc.used += spent;
+  telemetry_move(&s->telemetry, job->id, pos, ctx->source, ctx, spent, spent, sg->tc.game_time - sg->tc.used);
+}
+
+// The first job whose game nobody works on, or -1.
+int next_job(Server *s)
+{
+  for (int i = 0; i < s->job_count; i++)
+  {
+    if (!s->jobs[i].game->busy)
+      return i;
+  }
+  return -1;
+}
+
+void *server_worker(void *arg)
+{
+  Server *s = arg;
+  SearchContext ctx = {.evaluation = s->player->evaluation,
+                       .tt = s->tt,
+                       .probcut = s->player->probcut,
+                       .endgame_empties = s->options.endgame_empties,
+                       .threads = 1,
+                       .max_depth = s->options.max_depth};
+
+  pthread_mutex_lock(&s->lock);
+  while (true)
+  {
+    int i = next_job(s);
+    if (i < 0)
+    {
+      if (s->closing && !s->job_count)
+        break;
+      pthread_cond_wait(&s->changed, &s->lock);
+      continue;
+    }
+
+    Job job = s->jobs[i];
+    memmove(&s->jobs[i], &s->jobs[i + 1], (s->job_count - i - 1) * sizeof(*s->jobs));
+    s->job_count--;
+    job.game->busy = true;
+    pthread_cond_broadcast(&s->changed); // There is room for another job
+    pthread_mutex_unlock(&s->lock);
+
+    run_job(s, &job, &ctx);
+
+    pthread_mutex_lock(&s->lock);
+    job.game->busy = false;
+    if (job.type == COMMAND_EXIT)
+      job.game->used = false;
+    pthread_cond_broadcast(&s->changed);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+}
+
+// The game with this id. A new one if it's an init, otherwise NULL if we don't know it.
+ServerGame *find_game(Server *s, const char *id, CommandType type)
+{
+  ServerGame *free_game = NULL;
+
+  for (int i = 0; i < MAX_GAMES; i++)
+  {
+    if (s->games[i].used && !strcmp(s->games[i].id, id))
+      return &s->games[i];
+    if (!s->games[i].used && !free_game)
+      free_game = &s->games[i];
+  }
+
+  if (type != COMMAND_INIT || !free_game)
+    return NULL;
+
+  strcpy(free_game->id, id);
+  free_game->used = true;
+  free_game->started = false;
+  free_game->key = s->player->stateful ? next_random(&s->keys) : 0;
+  return free_game;
+}
+
+void serve(const ServerPlayer *player, Options options, TranspositionTable *tt, Book *book)
+{
+  static Server server; // The pool is large
+  static Protocol protocol;
+  Server *s = &server;
+  pthread_t workers[MAX_THREADS];
+  int started = 0;
+  char *line;
+
+  s->player = player;
+  s->options = options;
+  s->tt = tt;
+  s->book = book;
+  s->out_fd = STDOUT_FILENO;
+  s->keys = 0x47616D6573; // == "Games"
+  telemetry_init(&s->telemetry, options.telemetry_fd);
+  s->states = calloc(MAX_GAMES, player->state_size ? player->state_size : 1);
+  if (!s->states)
+  {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < MAX_GAMES; i++)
+    s->games[i].state = player->state_size ? s->states + i * player->state_size : NULL;
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_mutex_init(&s->out_lock, NULL);
+  pthread_cond_init(&s->changed, NULL);
+  while (started < options.threads && !pthread_create(&workers[started], NULL, server_worker, s))
+    started++;
+  if (!started)
+  {
+    fprintf(stderr, "Could not start any workers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  protocol_init(&protocol, STDIN_FILENO, STDOUT_FILENO);
+  while ((line = protocol_read_line(&protocol)))
+  {
+    double received = now_ms();
+    char *id = trim(line);
+    char *rest = id + strcspn(id, " \t");
+
+    if (!strcmp(id, "exit"))
+      break;
+
+    if (!*rest || rest - id >= MAX_GAME_ID)
+    {
+      fprintf(stderr, "Unknown command: %s\n", id);
+      continue;
+    }
+    *rest++ = '\0';
+
+    Command c = parse_command(rest);
+    if (c.type == COMMAND_MALFORMED)
+    {
+      fprintf(stderr, "Unknown command in game %s: %s\n", id, c.line);
+      continue;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    ServerGame *sg = find_game(s, id, c.type);
+    if (!sg)
+      fprintf(stderr, c.type == COMMAND_INIT ? "Too many games for %s\n" : "No game %s\n", id);
+    else
+    {
+      while (s->job_count == MAX_JOBS)
+        pthread_cond_wait(&s->changed, &s->lock);
+
+      Job job = {sg, "", c.type, c.stone, c.seed, c.pos, received};
+      strcpy(job.id, id);
+      s->jobs[s->job_count++] = job;
+
+      // Nothing may find the game anymore, but its last commands still get worked off.
+      if (c.type == COMMAND_EXIT)
+        sg->id[0] = '\0';
+      pthread_cond_broadcast(&s->changed);
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  pthread_mutex_lock(&s->lock);
+  s->closing = true;
+  pthread_cond_broadcast(&s->changed);
+  pthread_mutex_unlock(&s->lock);
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+
+  telemetry_flush(&s->telemetry);
+  free(s->states);
+  tt_free(tt);
+  book_close(book);
+}
+
+#endif
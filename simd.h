@@ -0,0 +1,93 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "definitions.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define HAVE_AVX2 0
+#endif
+
+#if HAVE_AVX2
+
+// AVX2
+// One 256 bit register holds four bitboards, so the four line directions
+// (sideways, down, and both diagonals) are handled side by side, each in its own lane.
+// Shifting left goes one way along a line, shifting right the other.
+// Everything in here is compiled for AVX2 no matter the compiler flags,
+// so it must only be called after init_dispatch found out the CPU can do it.
+
+#define AVX2 __attribute__((target("avx2")))
+
+// Shift counts and edge masks for the lanes: DRIGHT, DOWN, DOWN_LEFT, DOWN_RIGHT
+#define AVX2_SHIFTS _mm256_set_epi64x(DOWN_RIGHT, DOWN_LEFT, DOWN, DRIGHT)
+#define AVX2_EDGES _mm256_set_epi64x(ERIGHT, ERIGHT, -1, ERIGHT)
+
+static inline AVX2 uint_fast64_t or_lanes(__m256i v)
+{
+  __m128i half = _mm_or_si128(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  return _mm_cvtsi128_si64(_mm_or_si128(half, _mm_unpackhi_epi64(half, half)));
+}
+
+// get_moves for all four lane directions at once.
+AVX2 uint_fast64_t get_moves_avx2(uint_fast64_t mine, uint_fast64_t theirs)
+{
+  __m256i shift = AVX2_SHIFTS;
+  __m256i shift2 = _mm256_add_epi64(shift, shift);
+  __m256i p = _mm256_set1_epi64x(mine);
+  __m256i o = _mm256_and_si256(_mm256_set1_epi64x(theirs), AVX2_EDGES);
+
+  __m256i forward = _mm256_and_si256(o, _mm256_sllv_epi64(p, shift));
+  __m256i backward = _mm256_and_si256(o, _mm256_srlv_epi64(p, shift));
+
+  forward = _mm256_or_si256(forward, _mm256_and_si256(o, _mm256_sllv_epi64(forward, shift)));
+  backward = _mm256_or_si256(backward, _mm256_and_si256(o, _mm256_srlv_epi64(backward, shift)));
+
+  __m256i pairs_forward = _mm256_and_si256(o, _mm256_sllv_epi64(o, shift));
+  __m256i pairs_backward = _mm256_srlv_epi64(pairs_forward, shift);
+
+  forward = _mm256_or_si256(forward, _mm256_and_si256(pairs_forward, _mm256_sllv_epi64(forward, shift2)));
+  backward = _mm256_or_si256(backward, _mm256_and_si256(pairs_backward, _mm256_srlv_epi64(backward, shift2)));
+  forward = _mm256_or_si256(forward, _mm256_and_si256(pairs_forward, _mm256_sllv_epi64(forward, shift2)));
+  backward = _mm256_or_si256(backward, _mm256_and_si256(pairs_backward, _mm256_srlv_epi64(backward, shift2)));
+
+  __m256i moves = _mm256_or_si256(_mm256_sllv_epi64(forward, shift), _mm256_srlv_epi64(backward, shift));
+
+  return or_lanes(moves) & ~(mine | theirs);
+}
+
+// flips for all four lane directions at once.
+// We slide the new stone over enemy stones like reverse_dir does and only keep
+// the lines that end in one of our own stones.
+AVX2 uint_fast64_t flips_avx2(uint_fast64_t mine, uint_fast64_t theirs, uint_fast64_t move)
+{
+  __m256i shift = AVX2_SHIFTS;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i p = _mm256_set1_epi64x(mine);
+  __m256i m = _mm256_set1_epi64x(move);
+  __m256i o = _mm256_and_si256(_mm256_set1_epi64x(theirs), AVX2_EDGES);
+
+  __m256i forward = _mm256_and_si256(o, _mm256_sllv_epi64(m, shift));
+  __m256i backward = _mm256_and_si256(o, _mm256_srlv_epi64(m, shift));
+
+  for (int i = 0; i < 5; i++)
+  {
+    forward = _mm256_or_si256(forward, _mm256_and_si256(o, _mm256_sllv_epi64(forward, shift)));
+    backward = _mm256_or_si256(backward, _mm256_and_si256(o, _mm256_srlv_epi64(backward, shift)));
+  }
+
+  // A line without one of our stones behind it flips nothing.
+  __m256i capped_forward = _mm256_and_si256(p, _mm256_sllv_epi64(forward, shift));
+  __m256i capped_backward = _mm256_and_si256(p, _mm256_srlv_epi64(backward, shift));
+
+  forward = _mm256_andnot_si256(_mm256_cmpeq_epi64(capped_forward, zero), forward);
+  backward = _mm256_andnot_si256(_mm256_cmpeq_epi64(capped_backward, zero), backward);
+
+  return or_lanes(_mm256_or_si256(forward, backward));
+}
+
+#endif // HAVE_AVX2
+
+#endif
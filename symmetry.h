@@ -0,0 +1,143 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include "definitions.h"
+
+// SYMMETRY
+// Turning or mirroring the board doesn't change a position, so there are up to eight boards
+// for every position. The canonical one is whichever of them is smallest, comparing mine first.
+// Symmetry s is made of three steps, always in this order:
+//   s & 4: swap rows and columns (transpose)
+//   s & 1: mirror left and right
+//   s & 2: mirror top and bottom
+
+#define SYMMETRIES 8
+
+static inline int transform_square(int square, int s)
+{
+  int x = square % BOARD_WIDTH, y = square / BOARD_WIDTH;
+
+  if (s & 4)
+  {
+    int t = x;
+    x = y;
+    y = t;
+  }
+  if (s & 1)
+    x = BOARD_WIDTH - 1 - x;
+  if (s & 2)
+    y = BOARD_HEIGHT - 1 - y;
+
+  return shift_xy(x, y);
+}
+
+// Undoes transform_square: the same steps, backwards.
+static inline int untransform_square(int square, int s)
+{
+  int x = square % BOARD_WIDTH, y = square / BOARD_WIDTH;
+
+  if (s & 2)
+    y = BOARD_HEIGHT - 1 - y;
+  if (s & 1)
+    x = BOARD_WIDTH - 1 - x;
+  if (s & 4)
+  {
+    int t = x;
+    x = y;
+    y = t;
+  }
+
+  return shift_xy(x, y);
+}
+
+// The three steps as bit twiddling, square x + 8y is bit x + 8y of the stones.
+// Every one of them is a few delta swaps: swapping the bits in mask with the ones delta higher up.
+static inline uint_fast64_t delta_swap(uint_fast64_t stones, uint_fast64_t mask, int delta)
+{
+  uint_fast64_t t = (stones ^ (stones >> delta)) & mask;
+  return stones ^ t ^ (t << delta);
+}
+
+// Rows are bytes, so mirroring top and bottom just reverses the bytes.
+static inline uint_fast64_t mirror_vertical(uint_fast64_t stones)
+{
+  return __builtin_bswap64(stones);
+}
+
+// Reverses the bits in every byte: swaps neighbours, then pairs, then nibbles.
+static inline uint_fast64_t mirror_horizontal(uint_fast64_t stones)
+{
+  stones = delta_swap(stones, 0x5555555555555555, 1);
+  stones = delta_swap(stones, 0x3333333333333333, 2);
+  return delta_swap(stones, 0x0F0F0F0F0F0F0F0F, 4);
+}
+
+// Square (x, y) goes to (y, x): swaps the 4x4 blocks off the diagonal, then 2x2 blocks, then single squares.
+static inline uint_fast64_t transpose(uint_fast64_t stones)
+{
+  stones = delta_swap(stones, 0x00000000F0F0F0F0, 28);
+  stones = delta_swap(stones, 0x0000CCCC0000CCCC, 14);
+  return delta_swap(stones, 0x00AA00AA00AA00AA, 7);
+}
+
+static inline uint_fast64_t transform_stones(uint_fast64_t stones, int s)
+{
+  if (s & 4)
+    stones = transpose(stones);
+  if (s & 1)
+    stones = mirror_horizontal(stones);
+  if (s & 2)
+    stones = mirror_vertical(stones);
+
+  return stones;
+}
+
+// Undoes transform_stones, e.g. to turn a move on the canonical board back into one on ours.
+static inline uint_fast64_t untransform_stones(uint_fast64_t stones, int s)
+{
+  if (s & 2)
+    stones = mirror_vertical(stones);
+  if (s & 1)
+    stones = mirror_horizontal(stones);
+  if (s & 4)
+    stones = transpose(stones);
+
+  return stones;
+}
+
+static inline Board transform_board(Board b, int s)
+{
+  Board t = {transform_stones(b.mine, s), transform_stones(b.theirs, s)};
+  return t;
+}
+
+// The canonical board of b. symmetry tells which one turned b into it.
+// All eight boards come from transposing once and mirroring both boards each way.
+Board canonical_board(Board b, int *symmetry)
+{
+  Board t[SYMMETRIES];
+
+  t[0] = b;
+  t[4].mine = transpose(b.mine);
+  t[4].theirs = transpose(b.theirs);
+  for (int s = 0; s < SYMMETRIES; s += 4)
+  {
+    t[s + 1].mine = mirror_horizontal(t[s].mine);
+    t[s + 1].theirs = mirror_horizontal(t[s].theirs);
+    t[s + 2].mine = mirror_vertical(t[s].mine);
+    t[s + 2].theirs = mirror_vertical(t[s].theirs);
+    t[s + 3].mine = mirror_vertical(t[s + 1].mine);
+    t[s + 3].theirs = mirror_vertical(t[s + 1].theirs);
+  }
+
+  *symmetry = 0;
+  for (int s = 1; s < SYMMETRIES; s++)
+  {
+    if (t[s].mine < t[*symmetry].mine || (t[s].mine == t[*symmetry].mine && t[s].theirs < t[*symmetry].theirs))
+      *symmetry = s;
+  }
+
+  return t[*symmetry];
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "base.h"
+
+// TELEMETRY
+// With -l <fd>, every move we make leaves one line of JSON on that file descriptor, e.g.
+//   {"game": "3", "move": "c4", "mode": "midgame", "ms": 812.41, "nodes": 1234567, "nps": 1519652,
+//    "depth": 11, "tt_hit_rate": 0.213, "time_left_ms": 41230.5}
+// game is the id in server mode, otherwise we count the games from 1. move is none if we had to pass.
+// mode is book, ponder, endgame (searched to the end of the game in time) or midgame.
+// ms is the wall time from the command to our answer, and time_left_ms what the time control
+// leaves us for the rest of the game.
+// nps goes by the time the search actually ran, which for a pondered move is the opponent's.
+// The lines are collected in a buffer, which is only written once it is full, a game starts or we
+// are done. We only ever add to it after our move went out, so the referee never waits for us.
+// In server mode the workers share one Telemetry, the lock keeps their lines whole.
+
+#define TELEMETRY_BUFFER 65536
+#define TELEMETRY_LINE 512 // Longer than any line we write
+#define TELEMETRY_ID 80    // Room for a game id of server.h with every character escaped
+
+typedef struct Telemetry
+{
+  int fd; // -1 if nobody wants to know, then all of this does nothing
+  char buffer[TELEMETRY_BUFFER];
+  size_t written; // What is waiting in buffer
+  pthread_mutex_t lock;
+} Telemetry;
+
+static const char *const SOURCE_NAMES[] = {"book", "ponder", "endgame", "midgame"};
+
+void telemetry_init(Telemetry *t, int fd)
+{
+  t->fd = fd;
+  t->written = 0;
+  pthread_mutex_init(&t->lock, NULL);
+}
+
+// Writes out the buffer. The lock must be held.
+static void telemetry_write(Telemetry *t)
+{
+  size_t sent = 0;
+
+  while (sent < t->written)
+  {
+    ssize_t n = write(t->fd, t->buffer + sent, t->written - sent);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // Whoever reads it is gone, that's no reason to stop playing
+    sent += n;
+  }
+
+  t->written = 0;
+}
+
+void telemetry_flush(Telemetry *t)
+{
+  if (t->fd < 0)
+    return;
+
+  pthread_mutex_lock(&t->lock);
+  telemetry_write(t);
+  pthread_mutex_unlock(&t->lock);
+}
+
+// s as the inside of a JSON string. Whatever doesn't fit is cut off.
+static void json_escape(char *out, size_t size, const char *s)
+{
+  size_t n = 0;
+
+  for (; *s && n + 3 < size; s++)
+  {
+    if (*s == '"' || *s == '\\')
+      out[n++] = '\\';
+    if ((unsigned char)*s >= ' ')
+      out[n++] = *s;
+  }
+
+  out[n] = '\0';
+}
+
+// Our move pos in game, answered ms after the command came in. Unless it came from the book,
+// the search of ctx found it after searching for search_ms.
+void telemetry_move(Telemetry *t, const char *game, Position pos, MoveSource source, const SearchContext *ctx,
+                    double ms, double search_ms, double time_left)
+{
+  if (t->fd < 0)
+    return;
+
+  char move[5] = "none";
+  if (pos.x >= 0)
+  {
+    move[0] = 'a' + pos.x;
+    move[1] = '1' + pos.y;
+    move[2] = '\0';
+  }
+
+  char id[TELEMETRY_ID];
+  json_escape(id, sizeof(id), game);
+
+  bool searched = source != SOURCE_BOOK && pos.x >= 0; // Passing doesn't search either
+  uint64_t nodes = searched ? ctx->nodes : 0;
+  uint64_t nps = search_ms > 0 ? nodes * 1000.0 / search_ms : 0;
+  double hit_rate = searched && ctx->tt_probes ? (double)ctx->tt_hits / ctx->tt_probes : 0;
+
+  char line[TELEMETRY_LINE];
+  int length = snprintf(line, sizeof(line),
+                        "{\"game\": \"%s\", \"move\": \"%s\", \"mode\": \"%s\", \"ms\": %.2f, \"nodes\": %" PRIu64
+                        ", \"nps\": %" PRIu64 ", \"depth\": %d, \"tt_hit_rate\": %.3f, \"time_left_ms\": %.1f}\n",
+                        id, move, SOURCE_NAMES[source], ms, nodes, nps, searched ? ctx->depth : 0, hit_rate,
+                        time_left);
+  if (length < 0 || length >= TELEMETRY_LINE)
+    return;
+
+  pthread_mutex_lock(&t->lock);
+  if (t->written + length > TELEMETRY_BUFFER)
+    telemetry_write(t);
+  memcpy(t->buffer + t->written, line, length);
+  t->written += length;
+  pthread_mutex_unlock(&t->lock);
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "definitions.h"
+
+// TIME MANAGEMENT
+// The referee forfeits us if we think too long, so every search gets a deadline.
+// All times are in milliseconds on the monotonic clock, which never jumps around.
+
+#define MOVE_TIME 1000.0  // What we may think about a single move
+#define GAME_TIME 60000.0 // What we may think about all of our moves together
+#define TIME_SAFETY 10.0  // Kept back for reading, writing and the scheduler
+#define MIN_MOVES_TO_GO 4 // Never bet the remaining time on fewer moves than this
+#define STOP_CHECK_INTERVAL 1023 // Look at the clock every 1024 nodes
+
+typedef struct TimeControl
+{
+  double move_time;
+  double game_time;
+  double used; // Time spent on our moves in the current game
+} TimeControl;
+
+static inline double now_ms(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000.0 + t.tv_nsec / MILLION;
+}
+
+// How long we may search on a board with empties free squares.
+// We move on every second one of them, so that's what we split the time left into.
+double move_budget(TimeControl *tc, int empties)
+{
+  int moves_to_go = (empties + 1) / 2;
+  if (moves_to_go < MIN_MOVES_TO_GO)
+    moves_to_go = MIN_MOVES_TO_GO;
+
+  double budget = (tc->game_time - tc->used) / moves_to_go;
+  if (budget > tc->move_time)
+    budget = tc->move_time;
+
+  budget -= TIME_SAFETY;
+  return budget > 0 ? budget : 0;
+}
+
+// Called once per node. Only every STOP_CHECK_INTERVAL + 1 nodes we actually ask the clock,
+// and whether another thread told us to stop.
+static inline bool time_is_up(SearchContext *ctx)
+{
+  if (!(ctx->nodes & STOP_CHECK_INTERVAL) &&
+      ((ctx->deadline && now_ms() >= ctx->deadline) ||
+       (ctx->abort && __atomic_load_n(ctx->abort, __ATOMIC_RELAXED))))
+    ctx->stopped = true;
+
+  return ctx->stopped;
+}
+
+#endif
@@ -0,0 +1,326 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "pattern.h"
+#include "eval_features.h"
+
+// TRAINER
+// Learns the pattern weights from finished games. Every position of a game gets the disc difference
+// the game ended with, seen from the player to move, and the weights of each phase are fitted to those
+// by gradient descent on the squared error. The players add feature_evaluate on top of the patterns,
+// so the patterns only learn what the features don't already say: the target is the disc difference
+// less the features' score in discs. A weight only moves by the average error of the positions
+// it shows up in, so rare codes don't jump around and common ones don't take over.
+// All positions are stored in their canonical orientation, one game's opening is every game's opening.
+//
+// Game records are text, one game per line: the moves as column and row, e.g. f5d6c3d3c4.
+// Passes aren't written, whoever can't move just passes. Lines that aren't finished legal games are skipped.
+//
+// usage: train [-o weights] [-e epochs] [-r rate] [-j threads] records...
+
+#define TRAIN_EPOCHS 100 // Default for -e
+#define TRAIN_RATE 1.0   // Default for -r
+#define REPORT_EPOCHS 10 // How often we print the error
+#define MIN_COUNT 4      // Codes seen fewer times than this get only a part of their step
+
+typedef struct Sample
+{
+  Board board; // Canonical
+  float target; // Final disc difference for the player to move, less feature_evaluate in discs
+} Sample;
+
+typedef struct Samples
+{
+  Sample *samples;
+  size_t count;
+  size_t capacity;
+} Samples;
+
+// The gradient one thread gathered over its share of a phase.
+typedef struct Gradient
+{
+  float *error; // Summed error of the positions every weight is in
+  uint32_t *count;
+  double squared; // Summed squared error
+} Gradient;
+
+typedef struct Trainer
+{
+  Samples phases[PHASES];
+  float *weights; // In discs, PHASES * PATTERN_WEIGHTS
+  Gradient gradients[MAX_THREADS];
+  int threads;
+  int phase;
+  double rate;
+} Trainer;
+
+typedef struct TrainerThread
+{
+  Trainer *trainer;
+  int id;
+} TrainerThread;
+
+// difference is the final disc difference for the player to move in b.
+void add_sample(Samples *s, Board b, int difference)
+{
+  if (s->count == s->capacity)
+  {
+    s->capacity = s->capacity ? 2 * s->capacity : 4096;
+    s->samples = realloc(s->samples, s->capacity * sizeof(*s->samples));
+    if (!s->samples)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  int symmetry;
+  Sample sample = {canonical_board(b, &symmetry), difference - (float)feature_evaluate(b) / DISC_SCORE};
+  s->samples[s->count++] = sample;
+}
+
+// Replays one game and adds all its positions. Returns false if the line isn't a finished legal game.
+bool read_game(Trainer *trainer, const char *line)
+{
+  Board positions[BOARD_WIDTH * BOARD_HEIGHT];
+  bool black[BOARD_WIDTH * BOARD_HEIGHT]; // Whether black is to move in the position
+  int count = 0;
+  Game start = init_game(BLACK);
+  Board b = board_of(&start);
+  bool black_to_move = true;
+
+  for (const char *c = line; *c && *c != '\n'; c++)
+  {
+    if (isspace((unsigned char)*c))
+      continue;
+
+    int x = tolower((unsigned char)c[0]) - 'a', y = c[1] - '1';
+    if (x < 0 || x >= BOARD_WIDTH || y < 0 || y >= BOARD_HEIGHT)
+      return false;
+    c++;
+
+    if (!get_moves(b.mine, b.theirs))
+    {
+      b = make_pass(b);
+      black_to_move = !black_to_move;
+    }
+
+    uint_fast64_t move = field_at(x, y);
+    if (!(get_moves(b.mine, b.theirs) & move))
+      return false;
+
+    positions[count] = b;
+    black[count++] = black_to_move;
+    b = make_move(b, ctzll(move));
+    black_to_move = !black_to_move;
+  }
+
+  if (get_moves(b.mine, b.theirs) || get_moves(b.theirs, b.mine))
+    return false;
+
+  int black_difference = black_to_move ? popcountll(b.mine) - popcountll(b.theirs) : popcountll(b.theirs) - popcountll(b.mine);
+  for (int i = 0; i < count; i++)
+    add_sample(&trainer->phases[phase(positions[i])], positions[i], black[i] ? black_difference : -black_difference);
+
+  return true;
+}
+
+void read_records(Trainer *trainer, const char *path)
+{
+  char line[1024];
+  size_t games = 0, skipped = 0;
+  FILE *f = fopen(path, "r");
+
+  if (!f)
+  {
+    fprintf(stderr, "Could not open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  while (fgets(line, sizeof(line), f))
+  {
+    if (read_game(trainer, line))
+      games++;
+    else
+      skipped++;
+  }
+
+  fclose(f);
+  fprintf(stderr, "%s: %zu games, %zu lines skipped\n", path, games, skipped);
+}
+
+static inline float predict(const float *weights, uint32_t *codes)
+{
+  float sum = 0;
+  for (int i = 0; i < PATTERN_INSTANCES; i++)
+    sum += weights[instance_offset[i] + codes[i]];
+  return sum;
+}
+
+// One thread's share of a pass over the current phase.
+void *gather_gradient(void *arg)
+{
+  TrainerThread *t = arg;
+  Trainer *trainer = t->trainer;
+  Gradient *g = &trainer->gradients[t->id];
+  Samples *s = &trainer->phases[trainer->phase];
+  const float *weights = trainer->weights + (size_t)trainer->phase * PATTERN_WEIGHTS;
+  size_t first = s->count * t->id / trainer->threads, last = s->count * (t->id + 1) / trainer->threads;
+
+  memset(g->error, 0, PATTERN_WEIGHTS * sizeof(*g->error));
+  memset(g->count, 0, PATTERN_WEIGHTS * sizeof(*g->count));
+  g->squared = 0;
+
+  for (size_t n = first; n < last; n++)
+  {
+    uint32_t codes[PATTERN_INSTANCES];
+    pattern_codes(s->samples[n].board, codes);
+
+    float error = s->samples[n].target - predict(weights, codes);
+    g->squared += error * error;
+    for (int i = 0; i < PATTERN_INSTANCES; i++)
+    {
+      g->error[instance_offset[i] + codes[i]] += error;
+      g->count[instance_offset[i] + codes[i]]++;
+    }
+  }
+
+  return NULL;
+}
+
+// One step for every weight of the current phase. Returns the mean squared error before the step.
+double train_epoch(Trainer *trainer)
+{
+  pthread_t threads[MAX_THREADS];
+  TrainerThread args[MAX_THREADS];
+  int started = 1;
+
+  for (int i = 0; i < trainer->threads; i++)
+  {
+    args[i].trainer = trainer;
+    args[i].id = i;
+  }
+  while (started < trainer->threads && !pthread_create(&threads[started], NULL, gather_gradient, &args[started]))
+    started++;
+  for (int i = started; i < trainer->threads; i++)
+    gather_gradient(&args[i]); // Couldn't start a thread, so we take over its share
+  gather_gradient(&args[0]);
+  for (int i = 1; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  float *weights = trainer->weights + (size_t)trainer->phase * PATTERN_WEIGHTS;
+  double squared = 0;
+
+  for (int i = 0; i < trainer->threads; i++)
+    squared += trainer->gradients[i].squared;
+
+  // Every position is shared out over all copies of all patterns, so each gets its part of the error.
+  for (size_t w = 0; w < PATTERN_WEIGHTS; w++)
+  {
+    float error = 0;
+    uint32_t count = 0;
+    for (int i = 0; i < trainer->threads; i++)
+    {
+      error += trainer->gradients[i].error[w];
+      count += trainer->gradients[i].count[w];
+    }
+
+    if (count)
+      weights[w] += trainer->rate * error / (count < MIN_COUNT ? MIN_COUNT : count) / PATTERN_INSTANCES;
+  }
+
+  return trainer->phases[trainer->phase].count ? squared / trainer->phases[trainer->phase].count : 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *output = "reversi.weights";
+  int epochs = TRAIN_EPOCHS;
+  Trainer trainer = {.rate = TRAIN_RATE};
+  int opt;
+
+  trainer.threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (trainer.threads > MAX_THREADS)
+    trainer.threads = MAX_THREADS;
+
+  while ((opt = getopt(argc, argv, "o:e:r:j:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      output = optarg;
+      break;
+    case 'e':
+      epochs = atoi(optarg);
+      break;
+    case 'r':
+      trainer.rate = atof(optarg);
+      break;
+    case 'j':
+      trainer.threads = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-o weights] [-e epochs] [-r rate] [-j threads] records...\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind == argc || epochs < 1 || trainer.rate <= 0 || trainer.threads < 1 || trainer.threads > MAX_THREADS)
+  {
+    fprintf(stderr, "usage: %s [-o weights] [-e epochs] [-r rate] [-j threads] records...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  init_zobrist();
+  init_dispatch();
+  init_patterns();
+  init_features();
+
+  for (int i = optind; i < argc; i++)
+    read_records(&trainer, argv[i]);
+
+  trainer.weights = calloc((size_t)PHASES * PATTERN_WEIGHTS, sizeof(*trainer.weights));
+  for (int i = 0; i < trainer.threads; i++)
+  {
+    trainer.gradients[i].error = malloc(PATTERN_WEIGHTS * sizeof(float));
+    trainer.gradients[i].count = malloc(PATTERN_WEIGHTS * sizeof(uint32_t));
+    if (!trainer.gradients[i].error || !trainer.gradients[i].count)
+    {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (trainer.phase = 0; trainer.phase < PHASES; trainer.phase++)
+  {
+    double error = 0;
+    for (int e = 0; e < epochs; e++)
+    {
+      error = train_epoch(&trainer);
+      if (e % REPORT_EPOCHS == 0)
+        fprintf(stderr, "phase %d, epoch %d: %zu positions, mean squared error %.2f\n",
+                trainer.phase, e, trainer.phases[trainer.phase].count, error);
+    }
+    fprintf(stderr, "phase %d done: mean squared error %.2f\n", trainer.phase, error);
+  }
+
+  // Into the scores pattern_evaluate works with.
+  for (int p = 0; p < PHASES; p++)
+  {
+    for (size_t w = 0; w < PATTERN_WEIGHTS; w++)
+    {
+      float scaled = trainer.weights[(size_t)p * PATTERN_WEIGHTS + w] * DISC_SCORE * PATTERN_SCALE;
+      pattern_weights[p][w] = scaled > INT16_MAX ? INT16_MAX : scaled < -INT16_MAX ? -INT16_MAX : (int)(scaled + (scaled < 0 ? -0.5f : 0.5f));
+    }
+  }
+
+  if (!save_weights(output))
+  {
+    fprintf(stderr, "Could not write %s\n", output);
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stderr, "Wrote %s\n", output);
+  return EXIT_SUCCESS;
+}
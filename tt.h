@@ -0,0 +1,211 @@
+#ifndef TT_H
+#define TT_H
+
+#include "base.h"
+
+// TRANSPOSITION TABLE
+// Remembers what we already found out about a position, so reaching it again
+// by a different move order doesn't cost us a second search.
+// Four entries share one cache line. Looking up a position touches exactly one line.
+// All search threads share one table without any locks. Each entry stores its key XORed
+// with its data. If two threads write the same entry at once, the halves no longer fit
+// together, and the probe treats the entry as empty.
+
+#define TT_SIZE 64           // Default size in MB
+#define TT_MAX_SIZE (1 << 20) // Largest size in MB we accept, more than any machine we play on has
+#define TT_BUCKET_SIZE 4
+#define TT_NO_MOVE 0xFF
+
+typedef enum Bound
+{
+  BOUND_NONE = 0,
+  BOUND_UPPER = 1, // The real score is at most this (we failed low)
+  BOUND_LOWER = 2, // The real score is at least this (we failed high)
+  BOUND_EXACT = 3
+} Bound;
+
+// The payload is packed into a single word:
+//  bits  0-31  score
+//  bits 32-39  best move (square index or TT_NO_MOVE)
+//  bits 40-47  depth
+//  bits 48-55  bound
+//  bits 56-63  age, the search the entry was written in
+typedef struct TTEntry
+{
+  uint64_t key; // Hash of the position XOR data
+  uint64_t data;
+} TTEntry;
+
+typedef struct __attribute__((aligned(64))) TTBucket
+{
+  TTEntry entries[TT_BUCKET_SIZE];
+} TTBucket;
+
+typedef struct TranspositionTable
+{
+  TTBucket *buckets;
+  uint64_t mask; // Number of buckets - 1, always a power of two
+  uint8_t age;
+} TranspositionTable;
+
+// What a probe hands back, unpacked.
+typedef struct TTHit
+{
+  int score;
+  int move; // Square index or TT_NO_MOVE
+  int depth;
+  Bound bound;
+} TTHit;
+
+static inline uint64_t tt_pack(int score, int move, int depth, Bound bound, uint8_t age)
+{
+  return (uint32_t)score |
+         (uint64_t)(move & 0xFF) << 32 |
+         (uint64_t)(depth & 0xFF) << 40 |
+         (uint64_t)bound << 48 |
+         (uint64_t)age << 56;
+}
+
+static inline TTHit tt_unpack(uint64_t data)
+{
+  TTHit hit = {(int32_t)(data & 0xFFFFFFFF), (data >> 32) & 0xFF, (data >> 40) & 0xFF, (data >> 48) & 0xFF};
+  return hit;
+}
+
+static inline uint8_t tt_age(uint64_t data)
+{
+  return data >> 56;
+}
+
+// Reads an entry that another thread may be writing at the same time and returns the
+// hash of its position. A torn entry gives a hash that matches no position.
+static inline uint64_t tt_read(TTEntry *e, uint64_t *data)
+{
+  uint64_t key = __atomic_load_n(&e->key, __ATOMIC_RELAXED);
+  *data = __atomic_load_n(&e->data, __ATOMIC_RELAXED);
+  return key ^ *data;
+}
+
+static inline void tt_write(TTEntry *e, uint64_t hash, uint64_t data)
+{
+  __atomic_store_n(&e->key, hash ^ data, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->data, data, __ATOMIC_RELAXED);
+}
+
+// Allocates the largest power of two number of buckets that fits into size_mb.
+// Exits if there is not enough memory, since we can't play without it.
+TranspositionTable tt_create(size_t size_mb)
+{
+  TranspositionTable tt = {NULL, 0, 0};
+  size_t count = 1;
+
+  // Anything larger would overflow below, and we couldn't get it anyway.
+  if (size_mb > TT_MAX_SIZE)
+    size_mb = TT_MAX_SIZE;
+
+  while (count * 2 * sizeof(TTBucket) <= size_mb * 1024 * 1024)
+    count *= 2;
+
+  tt.buckets = aligned_alloc(sizeof(TTBucket), count * sizeof(TTBucket));
+  if (!tt.buckets)
+  {
+    fprintf(stderr, "Could not allocate %zu MB for the transposition table\n", size_mb);
+    exit(EXIT_FAILURE);
+  }
+  memset(tt.buckets, 0, count * sizeof(TTBucket));
+  tt.mask = count - 1;
+
+  return tt;
+}
+
+void tt_free(TranspositionTable *tt)
+{
+  free(tt->buckets);
+  tt->buckets = NULL;
+}
+
+// Forgets everything, e.g. before a new game. Only call this while no other thread is searching.
+void tt_clear(TranspositionTable *tt)
+{
+  memset(tt->buckets, 0, (tt->mask + 1) * sizeof(TTBucket));
+  tt->age = 0;
+}
+
+// Entries from older searches are still good, but may be replaced first.
+// Searches of other games may share the table (see server.h), so the age is atomic.
+static inline void tt_new_search(TranspositionTable *tt)
+{
+  __atomic_fetch_add(&tt->age, 1, __ATOMIC_RELAXED);
+}
+
+bool tt_probe(TranspositionTable *tt, uint64_t hash, TTHit *hit)
+{
+  TTBucket *bucket = &tt->buckets[hash & tt->mask];
+
+  for (int i = 0; i < TT_BUCKET_SIZE; i++)
+  {
+    uint64_t data;
+    if (tt_read(&bucket->entries[i], &data) == hash && data)
+    {
+      *hit = tt_unpack(data);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// tt_probe into the table of ctx, counting how often it knew the position.
+static inline bool tt_lookup(SearchContext *ctx, uint64_t hash, TTHit *hit)
+{
+  ctx->tt_probes++;
+  if (!tt_probe(ctx->tt, hash, hit))
+    return false;
+
+  ctx->tt_hits++;
+  return true;
+}
+
+// An entry for the same position is always overwritten, unless it came from a deeper search
+// in the current one and we don't bring an exact score. Otherwise the victim is the shallowest
+// entry, where entries from older searches count as shallower than any from the current one.
+void tt_store(TranspositionTable *tt, uint64_t hash, int score, int move, int depth, Bound bound)
+{
+  TTBucket *bucket = &tt->buckets[hash & tt->mask];
+  TTEntry *victim = &bucket->entries[0];
+  int victim_value = INT_MAX;
+  uint8_t age = __atomic_load_n(&tt->age, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < TT_BUCKET_SIZE; i++)
+  {
+    TTEntry *e = &bucket->entries[i];
+    uint64_t data;
+    uint64_t key = tt_read(e, &data);
+
+    if (key == hash && data)
+    {
+      TTHit old = tt_unpack(data);
+      if (tt_age(data) == age && old.depth > depth && bound != BOUND_EXACT)
+        return;
+      // Keep the old best move if we didn't find one ourselves.
+      if (move == TT_NO_MOVE)
+        move = old.move;
+      victim = e;
+      break;
+    }
+
+    int value = data ? tt_unpack(data).depth : -1;
+    if (data && tt_age(data) != age)
+      value -= 256;
+
+    if (value < victim_value)
+    {
+      victim = e;
+      victim_value = value;
+    }
+  }
+
+  tt_write(victim, hash, tt_pack(score, move, depth, bound, age));
+}
+
+#endif